@@ -0,0 +1,179 @@
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gpsdo_config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "solver.h"
+
+using namespace gpsdo_config;
+
+struct gpsdo_solver_ctx {
+  explicit gpsdo_solver_ctx(unsigned threads)
+      : threads{threads} {}
+
+  unsigned const threads;
+
+  // Scratch memory of single-threaded searches, released before each call
+  std::vector<std::byte> buffer = std::vector<std::byte>(1 << 20);
+  std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size()};
+
+  // Only valid for a single f1 and limits, so replaced when they change
+  std::optional<solver> sv;
+
+  std::string error;
+};
+
+namespace {
+
+constexpr gpsdo_limits to_c(hardware_limits const& lim) {
+  return {lim.VCO_LO, lim.VCO_HI, lim.F3_LO, lim.F3_HI, lim.GPS_HI};
+}
+
+hardware_limits from_c(gpsdo_limits const& lim) {
+  hardware_limits const rv{
+      lim.VCO_LO, lim.VCO_HI, lim.F3_LO, lim.F3_HI, lim.GPS_HI};
+  check_limits(rv);
+  return rv;
+}
+
+rat64 frequency(int64_t num, int64_t den) {
+  if (den == 0) {
+    throw std::invalid_argument("zero denominator");
+  }
+
+  rat64 const f(num, den);
+
+  if (f <= 0) {
+    throw std::invalid_argument("frequencies must be positive");
+  }
+
+  return f;
+}
+
+find algorithm_of(gpsdo_mode mode) {
+  switch (mode) {
+  case GPSDO_FIND_ANY:
+    return find::any;
+  case GPSDO_FIND_GOOD:
+    return find::good;
+  case GPSDO_FIND_BEST:
+    return find::best;
+  case GPSDO_FIND_ALL:
+    // The first `cap` solutions of find::all, which find::top_k finds much
+    // faster and without keeping all of them
+    return find::top_k;
+  }
+
+  throw std::invalid_argument("unknown mode");
+}
+
+} // namespace
+
+extern "C" {
+
+gpsdo_limits const gpsdo_si53xx_limits = to_c(si53xx_limits);
+gpsdo_limits const gpsdo_si53xx_relaxed_limits = to_c(si53xx_relaxed_limits);
+
+int gpsdo_api_version(void) { return GPSDO_CONFIG_API_VERSION; }
+
+gpsdo_solver_ctx* gpsdo_solver_ctx_new(unsigned threads) {
+  return new (std::nothrow) gpsdo_solver_ctx(threads);
+}
+
+void gpsdo_solver_ctx_free(gpsdo_solver_ctx* ctx) { delete ctx; }
+
+char const* gpsdo_solver_ctx_error(gpsdo_solver_ctx const* ctx) {
+  return ctx->error.c_str();
+}
+
+ptrdiff_t gpsdo_solve_into(
+    gpsdo_solver_ctx* ctx,
+    int64_t f1_num,
+    int64_t f1_den,
+    int64_t f2_num,
+    int64_t f2_den,
+    gpsdo_limits const* limits,
+    gpsdo_mode mode,
+    gpsdo_solution* out,
+    size_t cap) {
+  ctx->error.clear();
+
+  try {
+    auto const f1 = frequency(f1_num, f1_den);
+    auto const f2 = frequency(f2_num, f2_den);
+    auto const lim = limits ? from_c(*limits) : si53xx_limits;
+    auto const algorithm = algorithm_of(mode);
+
+    if (!out and cap > 0) {
+      throw std::invalid_argument("no output buffer");
+    }
+
+    // k = 0 would mean all solutions for find::top_k
+    if (algorithm == find::top_k and cap == 0) {
+      return 0;
+    }
+
+    if (!ctx->sv or ctx->sv->f1() != f1 or ctx->sv->limits() != lim) {
+      ctx->sv.emplace(f1, lim);
+    }
+
+    ctx->arena.release();
+
+    auto const solutions = ctx->sv->find_solutions(
+        f2, algorithm,
+        {.threads = ctx->threads, .top_k = cap, .memory = &ctx->arena});
+    size_t const n = std::min(solutions.size(), cap);
+
+    for (size_t i = 0; i < n; ++i) {
+      auto const& s = solutions[i];
+      out[i] = {s.fGPS, s.N31, s.N1_HS, s.NC1_LS, s.NC2_LS, s.N2_HS, s.N2_LS};
+    }
+
+    return static_cast<ptrdiff_t>(n);
+  } catch (std::bad_alloc const&) {
+    ctx->error = "out of memory";
+    return GPSDO_ERROR_OUT_OF_MEMORY;
+  } catch (std::invalid_argument const& e) {
+    ctx->error = e.what();
+    return GPSDO_ERROR_INVALID_ARGUMENT;
+  } catch (std::domain_error const& e) {
+    // e.g. boost::bad_rational
+    ctx->error = e.what();
+    return GPSDO_ERROR_INVALID_ARGUMENT;
+  } catch (std::exception const& e) {
+    ctx->error = e.what();
+    return GPSDO_ERROR_INTERNAL;
+  } catch (...) {
+    ctx->error = "unknown error";
+    return GPSDO_ERROR_INTERNAL;
+  }
+}
+
+} // extern "C"
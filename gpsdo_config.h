@@ -0,0 +1,137 @@
+#pragma once
+
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * C interface of the solver, built as the libgpsdo_config shared library
+ *
+ * All types are plain C, and the layout of the structs below only ever
+ * changes together with GPSDO_CONFIG_API_VERSION and the soname.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(GPSDO_CONFIG_BUILD)
+#define GPSDO_CONFIG_API __attribute__((visibility("default")))
+#else
+#define GPSDO_CONFIG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPSDO_CONFIG_API_VERSION 1
+
+/* Same values as gpsdo_config::hardware_limits */
+typedef struct gpsdo_limits {
+  int64_t VCO_LO;
+  int64_t VCO_HI;
+  int64_t F3_LO;
+  int64_t F3_HI;
+  int64_t GPS_HI;
+} gpsdo_limits;
+
+/* Same fields as gpsdo_config::solution */
+typedef struct gpsdo_solution {
+  uint32_t fGPS;
+  uint32_t N31;
+  uint32_t N1_HS;
+  uint32_t NC1_LS;
+  uint32_t NC2_LS;
+  uint32_t N2_HS;
+  uint32_t N2_LS;
+} gpsdo_solution;
+
+typedef enum gpsdo_mode {
+  GPSDO_FIND_ANY = 0,
+  GPSDO_FIND_GOOD = 1,
+  GPSDO_FIND_BEST = 2,
+  GPSDO_FIND_ALL = 3,
+} gpsdo_mode;
+
+/* Negative return values of gpsdo_solve_into() */
+enum {
+  GPSDO_ERROR_INVALID_ARGUMENT = -1,
+  GPSDO_ERROR_OUT_OF_MEMORY = -2,
+  GPSDO_ERROR_INTERNAL = -3,
+};
+
+typedef struct gpsdo_solver_ctx gpsdo_solver_ctx;
+
+/* The limits of the Si53xx chips, from the data sheet and relaxed */
+GPSDO_CONFIG_API extern gpsdo_limits const gpsdo_si53xx_limits;
+GPSDO_CONFIG_API extern gpsdo_limits const gpsdo_si53xx_relaxed_limits;
+
+/* GPSDO_CONFIG_API_VERSION of the library that is actually loaded */
+GPSDO_CONFIG_API int gpsdo_api_version(void);
+
+/*
+ * Create a context for solving frequency pairs
+ *
+ * A context keeps the scratch memory of the search and the PLL
+ * configurations found for the last f1 and limits between calls, so
+ * repeated calls are faster and mostly don't allocate. The scratch memory
+ * is only used with `threads` = 1, 0 means one thread per CPU core.
+ * Returns NULL if out of memory.
+ *
+ * A context must only be used by one thread at a time.
+ */
+GPSDO_CONFIG_API gpsdo_solver_ctx* gpsdo_solver_ctx_new(unsigned threads);
+
+GPSDO_CONFIG_API void gpsdo_solver_ctx_free(gpsdo_solver_ctx* ctx);
+
+/*
+ * Description of the error returned by the last call that failed
+ *
+ * The string is owned by the context and valid until the next call.
+ */
+GPSDO_CONFIG_API char const* gpsdo_solver_ctx_error(
+    gpsdo_solver_ctx const* ctx);
+
+/*
+ * Find solutions for f1 = f1_num / f1_den and f2 = f2_num / f2_den
+ *
+ * Writes at most `cap` solutions to `out`, ordered like the solutions of
+ * gpsdo_config::find_solutions(). For GPSDO_FIND_ALL, these are the first
+ * `cap` solutions, so there may be more if all of `out` was used. `limits`
+ * can be NULL for the data sheet limits, and must otherwise be accepted by
+ * gpsdo_config::check_limits().
+ *
+ * Returns the number of solutions written, which is 0 if there are none,
+ * or one of the negative GPSDO_ERROR_* values.
+ */
+GPSDO_CONFIG_API ptrdiff_t gpsdo_solve_into(
+    gpsdo_solver_ctx* ctx,
+    int64_t f1_num,
+    int64_t f1_den,
+    int64_t f2_num,
+    int64_t f2_den,
+    gpsdo_limits const* limits,
+    gpsdo_mode mode,
+    gpsdo_solution* out,
+    size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+ * GPSDO Configuration Daemon
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "gpsdo_server.h"
+#include "parallel.h"
+
+namespace {
+
+namespace po = boost::program_options;
+
+using namespace gpsdo_config;
+
+std::atomic<bool> stop_requested{false};
+
+void handle_signal(int) { stop_requested = true; }
+
+/**
+ * Whether `addr` is a socket with a listener. Only a refused connection
+ * means the socket was left behind by an instance that has gone away.
+ */
+bool socket_in_use(sockaddr_un const& addr) {
+  auto const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+
+  auto const rv
+      = ::connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+  auto const err = errno;
+  ::close(fd);
+
+  return rv == 0 or err != ECONNREFUSED;
+}
+
+int gpsdo_configd_main(int argc, char** argv) {
+  bool verbose = false;
+  unsigned threads = 0;
+  size_t cache_size = 10'000;
+  std::string path;
+
+  po::options_description desc("Options");
+  // clang-format off
+  desc.add_options()
+      ("socket", po::value<std::string>(&path), "unix socket to listen on")
+      ("threads,j", po::value<unsigned>(&threads)->default_value(threads),
+          "number of solver threads (0 = one per core)")
+      ("cache-size", po::value<size_t>(&cache_size)->default_value(cache_size),
+          "number of results to keep in memory (0 = none)")
+      ("verbose,v", po::bool_switch(&verbose), "log connections")
+      ("help,h", "produce help message");
+  // clang-format on
+
+  po::positional_options_description pos;
+  pos.add("socket", 1);
+
+  po::variables_map vm;
+  po::store(
+      po::command_line_parser(argc, argv).options(desc).positional(pos).run(),
+      vm);
+  po::notify(vm);
+
+  if (vm.count("help") or path.empty()) {
+    std::cerr
+        << "Usage: " << argv[0] << " socket [options...]\n\n"
+        << desc << "\n"
+        << "Listens on a unix socket and answers requests with the\n"
+        << "solutions `gpsdo-config` would find, without starting a process\n"
+        << "for each of them. Each request is a json object on a single line:\n"
+        << "\n"
+        << R"(  {"id": 1, "f1": "10M", "f2": "120M", "mode": "best"})" "\n\n"
+        << R"(`f1` is required, `f2` defaults to `f1`. `mode` is one of "any",)"
+        << "\n"
+        << R"("good" (default), "best", "all" or "top", which returns `top`)"
+        << "\n"
+        << R"((default: 10) solutions. `limits` is "datasheet" (default),)"
+        << "\n"
+        << R"("relaxed", or an object overriding some of VCO_LO, VCO_HI,)"
+        << "\n"
+        << "F3_LO, F3_HI and GPS_HI. Frequencies can be numbers or strings\n"
+        << "like on the command line.\n\n"
+        << "Each response is a json object on a single line, containing the\n"
+        << "request's `id`, if any, and either `solutions` or `error`.\n"
+        << "If no solution can exist, a `reason` is given along with the\n"
+        << "empty `solutions`.\n"
+        << "Clients can send more requests before reading the responses,\n"
+        << "which are always returned in request order.\n";
+    return vm.count("help") ? 0 : 2;
+  }
+
+  threads = resolve_threads(threads);
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "ERROR: socket path too long" << std::endl;
+    return 2;
+  }
+
+  std::strcpy(addr.sun_path, path.c_str());
+
+  auto const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+
+  // Remove a socket left behind by a previous instance, but never take
+  // over one that is still being served.
+  if (struct stat st;
+      ::lstat(path.c_str(), &st) == 0 and S_ISSOCK(st.st_mode)) {
+    if (socket_in_use(addr)) {
+      ::close(fd);
+      std::cerr << "ERROR: " << path << " is in use" << std::endl;
+      return 2;
+    }
+
+    ::unlink(path.c_str());
+  }
+
+  if (::bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0
+      or ::listen(fd, SOMAXCONN) != 0) {
+    auto const err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), path);
+  }
+
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+
+  if (verbose) {
+    std::cerr << "listening on " << path << " with " << threads
+              << " thread(s)" << std::endl;
+  }
+
+  {
+    server srv(threads, cache_size, verbose);
+    srv.run(fd, stop_requested);
+  }
+
+  ::close(fd);
+  ::unlink(path.c_str());
+
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  try {
+    return gpsdo_configd_main(argc, argv);
+  } catch (std::exception const& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 2;
+  }
+}
@@ -0,0 +1,197 @@
+/*
+ * GPSDO Solution Index Generator
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "parallel.h"
+#include "solution_index.h"
+#include "solver.h"
+
+namespace {
+
+namespace po = boost::program_options;
+
+using namespace gpsdo_config;
+
+struct frequency_pair {
+  rat64 f1;
+  rat64 f2;
+};
+
+/**
+ * Read frequency pairs, one `f1 [f2]` per line
+ *
+ * Empty lines and everything following a `#` are ignored. With
+ * `all_pairs`, every combination of the frequencies found in the input
+ * is returned instead.
+ */
+std::vector<frequency_pair> read_pairs(std::istream& is, bool all_pairs) {
+  std::vector<frequency_pair> pairs;
+  std::vector<rat64> freqs;
+  std::string line;
+
+  for (size_t lineno = 1; std::getline(is, line); ++lineno) {
+    if (auto pos = line.find('#'); pos != std::string::npos) {
+      line.erase(pos);
+    }
+
+    std::istringstream iss(line);
+    std::vector<rat64> fields;
+
+    try {
+      for (std::string f; iss >> f;) {
+        fields.push_back(parse_fraction(f));
+      }
+    } catch (std::exception const& e) {
+      throw std::runtime_error(
+          "line " + std::to_string(lineno) + ": " + e.what());
+    }
+
+    if (fields.empty()) {
+      continue;
+    }
+
+    if (fields.size() > 2) {
+      throw std::runtime_error(
+          "line " + std::to_string(lineno) + ": invalid input");
+    }
+
+    freqs.insert(freqs.end(), fields.begin(), fields.end());
+    pairs.push_back({fields.front(), fields.back()});
+  }
+
+  if (all_pairs) {
+    std::sort(freqs.begin(), freqs.end());
+    freqs.erase(std::unique(freqs.begin(), freqs.end()), freqs.end());
+    pairs.clear();
+
+    for (size_t i = 0; i < freqs.size(); ++i) {
+      for (size_t j = i; j < freqs.size(); ++j) {
+        pairs.push_back({freqs[i], freqs[j]});
+      }
+    }
+  }
+
+  return pairs;
+}
+
+int gpsdo_index_main(int argc, char** argv) {
+  bool all_pairs = false, verbose = false;
+  unsigned threads = 0;
+  std::string input, output;
+
+  po::options_description desc("Options");
+  // clang-format off
+  desc.add_options()
+      ("input", po::value<std::string>(&input), "frequency plan file")
+      ("output,o", po::value<std::string>(&output), "index file to write")
+      ("all-pairs", po::bool_switch(&all_pairs),
+          "index all pairs of frequencies found in the input")
+      ("threads,j", po::value<unsigned>(&threads)->default_value(threads),
+          "number of threads (0 = one per core)")
+      ("verbose,v", po::bool_switch(&verbose), "print progress")
+      ("help,h", "produce help message");
+  // clang-format on
+
+  po::positional_options_description pos;
+  pos.add("input", 1);
+
+  po::variables_map vm;
+  po::store(
+      po::command_line_parser(argc, argv).options(desc).positional(pos).run(),
+      vm);
+  po::notify(vm);
+
+  if (vm.count("help") or input.empty() or output.empty()) {
+    std::cerr
+        << "Usage: " << argv[0] << " input -o output [options...]\n\n"
+        << desc << "\n"
+        << "Computes the best solution for each frequency pair in `input`\n"
+        << "for both the standard and relaxed limits and writes them to an\n"
+        << "index that can be used with `gpsdo-config --index`. Each line of\n"
+        << "`input` contains `f1 [f2]`, everything after a `#` is ignored.\n";
+    return vm.count("help") ? 0 : 2;
+  }
+
+  std::ifstream ifs(input);
+
+  if (!ifs) {
+    std::cerr << "ERROR: cannot open " << input << std::endl;
+    return 2;
+  }
+
+  hardware_limits const* const limits[] = {
+      &si53xx_limits,
+      &si53xx_relaxed_limits,
+  };
+
+  auto const pairs = read_pairs(ifs, all_pairs);
+  auto const count = pairs.size() * std::size(limits);
+  std::vector<solution_index::entry> entries(count);
+  size_t done = 0;
+  std::mutex mx;
+
+  parallel_for(count, threads, [&](size_t i) {
+    auto const& p = pairs[i / std::size(limits)];
+    auto const& lim = *limits[i % std::size(limits)];
+    auto const best = find_solutions(p.f1, p.f2, lim, find::best);
+    auto& e = entries[i];
+
+    e = {.f1 = p.f1, .f2 = p.f2, .limits = lim, .best = {}};
+
+    if (!best.empty()) {
+      e.best = best.front();
+    }
+
+    if (verbose) {
+      std::lock_guard lock(mx);
+      std::cerr << ++done << "/" << count << ": " << p.f1 << " " << p.f2
+                << (best.empty() ? " (no solution)" : "") << std::endl;
+    }
+  });
+
+  auto const written = solution_index::write(output, std::move(entries));
+
+  std::cerr << "wrote " << written << " entries to " << output << std::endl;
+
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  try {
+    return gpsdo_index_main(argc, argv);
+  } catch (std::exception const& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 2;
+  }
+}
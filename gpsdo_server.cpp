@@ -0,0 +1,867 @@
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gpsdo_server.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "solver.h"
+
+namespace gpsdo_config {
+
+namespace {
+
+// Longest request accepted, and the number of requests of a connection
+// that can be in flight before we stop reading more of them.
+size_t constexpr MAX_REQUEST_SIZE = 64 << 10;
+size_t constexpr MAX_PIPELINE = 256;
+
+// Results with more solutions than this (i.e. from "all") aren't cached,
+// so a few of them can't use up lots of memory.
+size_t constexpr MAX_CACHED_SOLUTIONS = 1'000;
+
+/**
+ * A JSON value, as far as requests need it
+ *
+ * Numbers are kept as text, so frequencies can be parsed exactly with
+ * parse_fraction(). Requests don't contain arrays, so they aren't
+ * supported.
+ */
+struct json_value {
+  enum class type { null, boolean, number, string, object };
+
+  type kind{type::null};
+  std::string text;
+  std::vector<std::pair<std::string, json_value>> members;
+
+  json_value const* find(std::string_view key) const {
+    for (auto const& [k, v] : members) {
+      if (k == key) {
+        return &v;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class json_parser {
+ public:
+  explicit json_parser(std::string_view in)
+      : in_{in} {}
+
+  json_value parse() {
+    auto v = value(0);
+
+    skip_ws();
+
+    if (pos_ != in_.size()) {
+      fail("trailing characters");
+    }
+
+    return v;
+  }
+
+ private:
+  static size_t constexpr MAX_DEPTH = 8;
+
+  [[noreturn]] void fail(char const* what) const {
+    throw std::invalid_argument(
+        std::string("invalid json: ") + what + " at offset "
+        + std::to_string(pos_));
+  }
+
+  void skip_ws() {
+    while (pos_ < in_.size()
+           and (in_[pos_] == ' ' or in_[pos_] == '\t' or in_[pos_] == '\r'
+                or in_[pos_] == '\n')) {
+      ++pos_;
+    }
+  }
+
+  bool consume(char c) {
+    skip_ws();
+
+    if (pos_ < in_.size() and in_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool literal(std::string_view lit) {
+    if (in_.substr(pos_, lit.size()) == lit) {
+      pos_ += lit.size();
+      return true;
+    }
+
+    return false;
+  }
+
+  json_value value(size_t depth) {
+    json_value v;
+
+    skip_ws();
+
+    if (pos_ >= in_.size()) {
+      fail("unexpected end of input");
+    }
+
+    auto const c = in_[pos_];
+
+    if (c == '{') {
+      if (depth >= MAX_DEPTH) {
+        fail("nesting too deep");
+      }
+
+      ++pos_;
+      v.kind = json_value::type::object;
+
+      if (!consume('}')) {
+        do {
+          skip_ws();
+          auto key = string();
+
+          if (!consume(':')) {
+            fail("expected ':'");
+          }
+
+          v.members.emplace_back(std::move(key), value(depth + 1));
+        } while (consume(','));
+
+        if (!consume('}')) {
+          fail("expected '}'");
+        }
+      }
+    } else if (c == '"') {
+      v.kind = json_value::type::string;
+      v.text = string();
+    } else if (c == '-' or (c >= '0' and c <= '9')) {
+      v.kind = json_value::type::number;
+      v.text = number();
+    } else if (literal("true")) {
+      v.kind = json_value::type::boolean;
+      v.text = "true";
+    } else if (literal("false")) {
+      v.kind = json_value::type::boolean;
+      v.text = "false";
+    } else if (!literal("null")) {
+      fail("unexpected character");
+    }
+
+    return v;
+  }
+
+  std::string number() {
+    auto const start = pos_;
+
+    auto digits = [&] {
+      auto const first = pos_;
+      while (pos_ < in_.size() and in_[pos_] >= '0' and in_[pos_] <= '9') {
+        ++pos_;
+      }
+      if (pos_ == first) {
+        fail("invalid number");
+      }
+    };
+
+    if (in_[pos_] == '-') {
+      ++pos_;
+    }
+
+    digits();
+
+    if (pos_ < in_.size() and in_[pos_] == '.') {
+      ++pos_;
+      digits();
+    }
+
+    if (pos_ < in_.size() and (in_[pos_] == 'e' or in_[pos_] == 'E')) {
+      ++pos_;
+      if (pos_ < in_.size() and (in_[pos_] == '+' or in_[pos_] == '-')) {
+        ++pos_;
+      }
+      digits();
+    }
+
+    return std::string(in_.substr(start, pos_ - start));
+  }
+
+  std::string string() {
+    std::string rv;
+
+    if (pos_ >= in_.size() or in_[pos_] != '"') {
+      fail("expected string");
+    }
+
+    for (++pos_; pos_ < in_.size(); ++pos_) {
+      auto const c = in_[pos_];
+
+      if (c == '"') {
+        ++pos_;
+        return rv;
+      }
+
+      if (static_cast<unsigned char>(c) < 0x20) {
+        fail("control character in string");
+      }
+
+      if (c != '\\') {
+        rv += c;
+        continue;
+      }
+
+      if (++pos_ >= in_.size()) {
+        break;
+      }
+
+      switch (in_[pos_]) {
+      case '"':
+      case '\\':
+      case '/':
+        rv += in_[pos_];
+        break;
+      case 'b':
+        rv += '\b';
+        break;
+      case 'f':
+        rv += '\f';
+        break;
+      case 'n':
+        rv += '\n';
+        break;
+      case 'r':
+        rv += '\r';
+        break;
+      case 't':
+        rv += '\t';
+        break;
+      case 'u':
+        append_utf8(rv, code_point());
+        break;
+      default:
+        fail("invalid escape sequence");
+      }
+    }
+
+    fail("unterminated string");
+  }
+
+  // Surrogate pairs are not supported, requests should never need them.
+  unsigned code_point() {
+    unsigned cp = 0;
+
+    for (int i = 0; i < 4; ++i) {
+      if (++pos_ >= in_.size()
+          or !std::isxdigit(static_cast<unsigned char>(in_[pos_]))) {
+        fail("invalid escape sequence");
+      }
+
+      auto const h = in_[pos_];
+      cp = cp * 16 + (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+    }
+
+    if (cp >= 0xD800 and cp < 0xE000) {
+      fail("surrogates are not supported");
+    }
+
+    return cp;
+  }
+
+  static void append_utf8(std::string& s, unsigned cp) {
+    if (cp < 0x80) {
+      s += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      s += static_cast<char>(0xC0 | (cp >> 6));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      s += static_cast<char>(0xE0 | (cp >> 12));
+      s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  std::string_view const in_;
+  size_t pos_{0};
+};
+
+std::string json_escape(std::string const& str) {
+  std::string rv;
+
+  for (auto c : str) {
+    if (c == '"' or c == '\\') {
+      rv += '\\';
+      rv += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      rv += buf;
+    } else {
+      rv += c;
+    }
+  }
+
+  return rv;
+}
+
+struct request {
+  rat64 f1;
+  rat64 f2;
+  hardware_limits limits;
+  find algorithm;
+  size_t top_k;
+};
+
+rat64 get_frequency(json_value const& v, char const* name) {
+  using type = json_value::type;
+  rat64 f;
+
+  if (v.kind != type::number and v.kind != type::string) {
+    throw std::invalid_argument(
+        std::string(name) + " must be a number or a string");
+  }
+
+  try {
+    f = parse_fraction(v.text);
+  } catch (std::exception const&) {
+    throw std::invalid_argument(std::string("invalid ") + name);
+  }
+
+  if (f <= 0) {
+    throw std::invalid_argument(std::string(name) + " must be positive");
+  }
+
+  return f;
+}
+
+int64_t get_integer(json_value const& v, char const* name) {
+  if (v.kind != json_value::type::number or v.text.size() > 18
+      or v.text.find_first_not_of("0123456789") != std::string::npos) {
+    throw std::invalid_argument(
+        std::string(name) + " must be a non-negative integer");
+  }
+
+  return std::stoll(v.text);
+}
+
+/**
+ * `limits` is either "datasheet", "relaxed" or an object overriding some
+ * of the datasheet limits
+ */
+hardware_limits get_limits(json_value const* v) {
+  struct {
+    char const* name;
+    int64_t hardware_limits::*field;
+  } const fields[] = {
+      {"VCO_LO", &hardware_limits::VCO_LO},
+      {"VCO_HI", &hardware_limits::VCO_HI},
+      {"F3_LO", &hardware_limits::F3_LO},
+      {"F3_HI", &hardware_limits::F3_HI},
+      {"GPS_HI", &hardware_limits::GPS_HI},
+  };
+
+  if (!v or (v->kind == json_value::type::string and v->text == "datasheet")) {
+    return si53xx_limits;
+  }
+
+  if (v->kind == json_value::type::string and v->text == "relaxed") {
+    return si53xx_relaxed_limits;
+  }
+
+  if (v->kind != json_value::type::object) {
+    throw std::invalid_argument(
+        "limits must be \"datasheet\", \"relaxed\" or an object");
+  }
+
+  auto lim = si53xx_limits;
+
+  for (auto const& [key, value] : v->members) {
+    auto it = std::find_if(
+        std::begin(fields), std::end(fields),
+        [&key](auto const& f) { return key == f.name; });
+
+    if (it == std::end(fields)) {
+      throw std::invalid_argument("unknown limit: " + key);
+    }
+
+    lim.*(it->field) = get_integer(value, it->name);
+  }
+
+  check_limits(lim);
+  return lim;
+}
+
+request make_request(json_value const& doc) {
+  static std::map<std::string, find, std::less<>> const modes{
+      {"any", find::any}, {"good", find::good}, {"best", find::best},
+      {"all", find::all}, {"top", find::top_k},
+  };
+
+  for (auto const& [key, value] : doc.members) {
+    if (key != "id" and key != "f1" and key != "f2" and key != "mode"
+        and key != "top" and key != "limits") {
+      throw std::invalid_argument("unknown field: " + key);
+    }
+  }
+
+  auto const* f1 = doc.find("f1");
+
+  if (!f1) {
+    throw std::invalid_argument("f1 is required");
+  }
+
+  request req{
+      .f1 = get_frequency(*f1, "f1"),
+      .f2 = 0,
+      .limits = get_limits(doc.find("limits")),
+      .algorithm = find::good,
+      .top_k = 10,
+  };
+
+  auto const* f2 = doc.find("f2");
+
+  req.f2 = f2 ? get_frequency(*f2, "f2") : req.f1;
+
+  if (auto const* mode = doc.find("mode")) {
+    auto it = modes.find(mode->text);
+
+    if (mode->kind != json_value::type::string or it == modes.end()) {
+      throw std::invalid_argument(
+          "mode must be one of \"any\", \"good\", \"best\", \"all\", "
+          "\"top\"");
+    }
+
+    req.algorithm = it->second;
+  }
+
+  if (auto const* top = doc.find("top")) {
+    req.top_k = get_integer(*top, "top");
+
+    if (req.top_k < 1) {
+      throw std::invalid_argument("top must be at least 1");
+    }
+  }
+
+  return req;
+}
+
+std::string cache_key(request const& req) {
+  std::ostringstream oss;
+  auto const& lim = req.limits;
+
+  oss << req.f1 << " " << req.f2 << " " << lim.VCO_LO << " " << lim.VCO_HI
+      << " " << lim.F3_LO << " " << lim.F3_HI << " " << lim.GPS_HI << " "
+      << static_cast<int>(req.algorithm);
+
+  if (req.algorithm == find::top_k) {
+    oss << " " << req.top_k;
+  }
+
+  return oss.str();
+}
+
+/**
+ * In-memory cache of the results of recent requests
+ *
+ * When full, the least recently used result is evicted.
+ */
+class lru_cache {
+ public:
+  using value_type = std::shared_ptr<std::vector<solution> const>;
+
+  explicit lru_cache(size_t capacity)
+      : capacity_{capacity} {}
+
+  value_type find(std::string const& key) {
+    std::lock_guard lock(mx_);
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      return nullptr;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    return it->second->second;
+  }
+
+  void insert(std::string const& key, value_type value) {
+    if (capacity_ == 0 or value->size() > MAX_CACHED_SOLUTIONS) {
+      return;
+    }
+
+    std::lock_guard lock(mx_);
+
+    // Another thread may have solved the same request concurrently.
+    if (index_.count(key)) {
+      return;
+    }
+
+    entries_.emplace_front(key, std::move(value));
+    index_.emplace(key, entries_.begin());
+
+    if (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  using entry_list = std::list<std::pair<std::string, value_type>>;
+
+  size_t const capacity_;
+  entry_list entries_;
+  std::unordered_map<std::string, entry_list::iterator> index_;
+  std::mutex mx_;
+};
+
+std::vector<solution> solve(request const& req) {
+  // Each thread keeps its scratch memory between requests, so solving
+  // doesn't need to allocate anything but the result.
+  struct scratch_arena {
+    std::vector<std::byte> buffer = std::vector<std::byte>(1 << 20);
+    std::pmr::monotonic_buffer_resource mr{buffer.data(), buffer.size()};
+  };
+
+  thread_local scratch_arena arena;
+
+  arena.mr.release();
+
+  return find_solutions(
+      req.f1, req.f2, req.limits, req.algorithm,
+      {.top_k = req.top_k, .memory = &arena.mr});
+}
+
+/**
+ * Handle a single request line and return the response line
+ */
+std::string handle_request(std::string_view line, lru_cache& cache) {
+  std::string id;
+
+  try {
+    auto const doc = json_parser(line).parse();
+
+    if (doc.kind != json_value::type::object) {
+      throw std::invalid_argument("request must be a json object");
+    }
+
+    if (auto const* v = doc.find("id")) {
+      if (v->kind == json_value::type::string) {
+        id = "\"" + json_escape(v->text) + "\"";
+      } else if (v->kind == json_value::type::number) {
+        id = v->text;
+      } else {
+        throw std::invalid_argument("id must be a number or a string");
+      }
+    }
+
+    auto const req = make_request(doc);
+    auto const key = cache_key(req);
+    auto result = cache.find(key);
+
+    if (!result) {
+      result = std::make_shared<std::vector<solution> const>(solve(req));
+      cache.insert(key, result);
+    }
+
+    std::ostringstream oss;
+
+    oss << "{";
+
+    if (!id.empty()) {
+      oss << "\"id\": " << id << ", ";
+    }
+
+    oss << "\"solutions\": [";
+
+    for (auto const& s : *result) {
+      oss << (&s == result->data() ? "" : ", ") << "{\"fGPS\": " << s.fGPS
+          << ", \"N31\": " << s.N31 << ", \"N2_LS\": " << s.N2_LS
+          << ", \"N2_HS\": " << s.N2_HS << ", \"N1_HS\": " << s.N1_HS
+          << ", \"NC1_LS\": " << s.NC1_LS << ", \"NC2_LS\": " << s.NC2_LS
+          << "}";
+    }
+
+    oss << "]";
+
+    if (result->empty()) {
+      auto const reason = check_feasibility(req.f1, req.f2, req.limits);
+
+      if (reason != infeasibility::none) {
+        oss << ", \"reason\": \"" << json_escape(describe(reason)) << "\"";
+      }
+    }
+
+    oss << "}\n";
+
+    return oss.str();
+  } catch (std::exception const& e) {
+    return "{" + (id.empty() ? "" : "\"id\": " + id + ", ") + "\"error\": \""
+           + json_escape(e.what()) + "\"}\n";
+  }
+}
+
+/**
+ * A client connection
+ *
+ * Requests are read by the connection's own thread and solved by the
+ * thread pool. Each response is written as soon as the responses to all
+ * previous requests have been written, so clients can pipeline requests
+ * and still get the responses in order. The socket is closed once the
+ * client has closed its end and all responses have been written.
+ */
+class connection : public std::enable_shared_from_this<connection> {
+ public:
+  explicit connection(int fd)
+      : fd_{fd} {}
+
+  ~connection() { ::close(fd_); }
+
+  // Returns the number of requests read
+  uint64_t serve(thread_pool& pool, lru_cache& cache) {
+    std::array<char, 4096> chunk;
+    std::string buf;
+    uint64_t seq = 0;
+
+    auto submit = [&](std::string line) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        return true;
+      }
+
+      std::unique_lock lock(mx_);
+      cv_.wait(lock, [this] { return in_flight_ < MAX_PIPELINE or broken_; });
+
+      if (broken_) {
+        return false;
+      }
+
+      ++in_flight_;
+      lock.unlock();
+
+      pool.submit([self = shared_from_this(), s = seq++,
+                   line = std::move(line), &cache] {
+        self->respond(s, handle_request(line, cache));
+      });
+
+      return true;
+    };
+
+    for (;;) {
+      auto const n = ::recv(fd_, chunk.data(), chunk.size(), 0);
+
+      if (n < 0 and errno == EINTR) {
+        continue;
+      }
+
+      if (n <= 0) {
+        break;
+      }
+
+      buf.append(chunk.data(), n);
+
+      size_t start = 0;
+
+      for (size_t nl; (nl = buf.find('\n', start)) != std::string::npos;
+           start = nl + 1) {
+        if (!submit(buf.substr(start, nl - start))) {
+          return seq;
+        }
+      }
+
+      buf.erase(0, start);
+
+      if (buf.size() > MAX_REQUEST_SIZE) {
+        std::unique_lock lock(mx_);
+        ++in_flight_;
+        lock.unlock();
+        respond(seq++, "{\"error\": \"request too large\"}\n");
+        return seq;
+      }
+    }
+
+    // The last request doesn't need to be terminated by a newline.
+    submit(std::move(buf));
+
+    return seq;
+  }
+
+  // Wake up serve() and fail all further writes
+  void shutdown() { ::shutdown(fd_, SHUT_RDWR); }
+
+ private:
+  void respond(uint64_t seq, std::string response) {
+    std::lock_guard lock(mx_);
+
+    pending_.emplace(seq, std::move(response));
+
+    while (!pending_.empty() and pending_.begin()->first == next_write_) {
+      if (!broken_) {
+        send_all(pending_.begin()->second);
+      }
+
+      pending_.erase(pending_.begin());
+      ++next_write_;
+      --in_flight_;
+    }
+
+    cv_.notify_all();
+  }
+
+  void send_all(std::string_view data) {
+    while (!data.empty()) {
+      auto const n = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+
+      if (n < 0 and errno == EINTR) {
+        continue;
+      }
+
+      if (n <= 0) {
+        broken_ = true;
+        return;
+      }
+
+      data.remove_prefix(n);
+    }
+  }
+
+  int const fd_;
+  std::mutex mx_;
+  std::condition_variable cv_;
+  std::map<uint64_t, std::string> pending_;
+  uint64_t next_write_{0};
+  size_t in_flight_{0};
+  bool broken_{false};
+};
+
+} // namespace
+
+class server::impl {
+ public:
+  impl(unsigned threads, size_t cache_size, bool verbose)
+      : cache_{cache_size}
+      , pool_{threads}
+      , verbose_{verbose} {}
+
+  void run(int listen_fd, std::atomic<bool> const& stop) {
+    while (!stop) {
+      pollfd pfd{.fd = listen_fd, .events = POLLIN, .revents = 0};
+
+      if (::poll(&pfd, 1, 200) <= 0) {
+        continue;
+      }
+
+      auto const fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+      if (fd < 0) {
+        continue;
+      }
+
+      auto conn = std::make_shared<connection>(fd);
+
+      {
+        std::lock_guard lock(mx_);
+        active_.emplace(conn.get(), conn);
+      }
+
+      std::thread([this, conn] { serve(conn); }).detach();
+    }
+
+    std::unique_lock lock(mx_);
+
+    for (auto const& [_, weak] : active_) {
+      if (auto conn = weak.lock()) {
+        conn->shutdown();
+      }
+    }
+
+    cv_.wait(lock, [this] { return active_.empty(); });
+  }
+
+ private:
+  void serve(std::shared_ptr<connection> conn) {
+    if (verbose_) {
+      log("client connected");
+    }
+
+    auto const requests = conn->serve(pool_, cache_);
+
+    if (verbose_) {
+      log("client disconnected after " + std::to_string(requests)
+          + " request(s)");
+    }
+
+    std::lock_guard lock(mx_);
+    active_.erase(conn.get());
+    cv_.notify_all();
+  }
+
+  void log(std::string const& msg) {
+    std::lock_guard lock(log_mx_);
+    std::cerr << msg << std::endl;
+  }
+
+  // Jobs still queued when the pool is destroyed are run by its
+  // destructor and use the cache, so the pool must be destroyed first.
+  lru_cache cache_;
+  thread_pool pool_;
+  bool const verbose_;
+  std::mutex mx_;
+  std::condition_variable cv_;
+  std::unordered_map<connection*, std::weak_ptr<connection>> active_;
+  std::mutex log_mx_;
+};
+
+server::server(unsigned threads, size_t cache_size, bool verbose)
+    : impl_{std::make_unique<impl>(threads, cache_size, verbose)} {}
+
+server::~server() = default;
+
+void server::run(int listen_fd, std::atomic<bool> const& stop) {
+  impl_->run(listen_fd, stop);
+}
+
+} // namespace gpsdo_config
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace gpsdo_config {
+
+/**
+ * Solver server of gpsdo-configd
+ *
+ * Answers json requests, one per line, on all connections accepted from
+ * a listening socket. Requests are solved by a pool of `threads` threads,
+ * and the results of up to `cache_size` recent requests are kept in
+ * memory.
+ */
+class server {
+ public:
+  server(unsigned threads, size_t cache_size, bool verbose);
+  ~server();
+
+  server(server const&) = delete;
+  server& operator=(server const&) = delete;
+
+  // Accept connections on `listen_fd` until `stop` is set, then close all
+  // connections. Requests that are still queued when this returns are
+  // solved, but not answered, before the destructor returns.
+  void run(int listen_fd, std::atomic<bool> const& stop);
+
+ private:
+  class impl;
+
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace gpsdo_config
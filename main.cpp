@@ -19,74 +19,660 @@
  * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <cctype>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 
+#include "parallel.h"
+#include "solution_cache.h"
+#include "solution_index.h"
 #include "solver.h"
 
 namespace {
 
 namespace po = boost::program_options;
 
-gpsdo_config::rat64 parse_fraction(std::string const& str) {
-  int64_t num = 0, den = 1, integral = 0, unit = 1;
-  bool decimal = false, blank = false, frac = false;
+enum class output_format { text, cmdline, ndjson, csv, binary };
 
-  for (auto s : str) {
-    if (s == '.') {
-      if (decimal or blank or frac) {
-        throw std::invalid_argument("invalid input");
+struct output_options {
+  bool verbose{false};
+  output_format format{output_format::text};
+};
+
+/**
+ * Buffer for everything written to stdout
+ *
+ * Results can have hundreds of thousands of records, and writing them
+ * one by one, let alone flushing after each of them, takes much longer
+ * than finding them. Output is collected here and written in chunks of
+ * about a megabyte, or after each record if stdout is a terminal.
+ */
+class output_buffer {
+ public:
+  static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+  output_buffer()
+      : interactive_{::isatty(STDOUT_FILENO) == 1} {
+    buf_.reserve(CHUNK_SIZE + 4096);
+  }
+
+  ~output_buffer() { flush(); }
+
+  output_buffer& operator<<(std::string_view str) {
+    buf_ += str;
+    return *this;
+  }
+
+  output_buffer& operator<<(char c) {
+    buf_ += c;
+    return *this;
+  }
+
+  output_buffer& operator<<(uint32_t v) {
+    char tmp[16];
+    auto const res = std::to_chars(std::begin(tmp), std::end(tmp), v);
+    buf_.append(tmp, res.ptr);
+    return *this;
+  }
+
+  void put_le32(uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+      buf_ += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+  }
+
+  // To be called at the end of each record
+  void end_record() {
+    if (interactive_ or buf_.size() >= CHUNK_SIZE) {
+      flush();
+    }
+  }
+
+  void flush() {
+    std::cout.write(buf_.data(), buf_.size());
+    std::cout.flush();
+    buf_.clear();
+  }
+
+ private:
+  bool const interactive_;
+  std::string buf_;
+};
+
+output_buffer stdout_buffer;
+
+std::string json_escape(std::string const& str) {
+  std::string rv;
+
+  for (auto c : str) {
+    if (c == '"' or c == '\\') {
+      rv += '\\';
+      rv += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      rv += buf;
+    } else {
+      rv += c;
+    }
+  }
+
+  return rv;
+}
+
+std::string csv_escape(std::string const& str) {
+  if (str.find_first_of(",\"\r\n") == std::string::npos) {
+    return str;
+  }
+
+  std::string rv = "\"";
+
+  for (auto c : str) {
+    if (c == '"') {
+      rv += '"';
+    }
+    rv += c;
+  }
+
+  return rv + "\"";
+}
+
+/**
+ * Layout of `--format binary`
+ *
+ * A 16 byte header is followed by one record per solution. All values are
+ * little-endian uint32, the records are the fields of `solution` in
+ * declaration order.
+ */
+constexpr char BINARY_MAGIC[8] = {'G', 'P', 'S', 'D', 'O', 'S', 'O', 'L'};
+constexpr uint32_t BINARY_VERSION = 1;
+constexpr uint32_t BINARY_RECORD_SIZE = 7 * sizeof(uint32_t);
+
+/**
+ * Print anything that precedes the solutions in the requested format
+ *
+ * `with_id` is set if solutions will be printed with an id.
+ */
+void print_header(output_options const& opts, bool with_id) {
+  if (opts.format == output_format::csv) {
+    stdout_buffer << (with_id ? "id," : "")
+                  << "fGPS,N31,N2_LS,N2_HS,N1_HS,NC1_LS,NC2_LS\n";
+    stdout_buffer.end_record();
+  } else if (opts.format == output_format::binary) {
+    stdout_buffer << std::string_view(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    stdout_buffer.put_le32(BINARY_VERSION);
+    stdout_buffer.put_le32(BINARY_RECORD_SIZE);
+    stdout_buffer.end_record();
+  }
+}
+
+/**
+ * Print a solution in the requested format(s)
+ *
+ * If `id` is not empty, it will be included in the output so it can be
+ * correlated with the input in batch mode.
+ */
+void print_solution(
+    gpsdo_config::solution const& s,
+    output_options const& opts,
+    std::string const& id = {}) {
+  auto& out = stdout_buffer;
+
+  if (opts.verbose or opts.format == output_format::text) {
+    if (!id.empty()) {
+      std::cerr << id << ": ";
+    }
+    s.write(std::cerr, opts.verbose);
+    std::cerr << std::endl;
+  }
+
+  switch (opts.format) {
+  case output_format::text:
+    return;
+
+  case output_format::cmdline:
+    if (!id.empty()) {
+      out << id << ' ';
+    }
+    out << "--gps " << s.fGPS << " --n31 " << s.N31 << " --n2_ls " << s.N2_LS
+        << " --n2_hs " << s.N2_HS << " --n1_hs " << s.N1_HS << " --nc1_ls "
+        << s.NC1_LS << " --nc2_ls " << s.NC2_LS << '\n';
+    break;
+
+  case output_format::ndjson:
+    out << '{';
+    if (!id.empty()) {
+      out << "\"id\": \"" << json_escape(id) << "\", ";
+    }
+    out << "\"fGPS\": " << s.fGPS << ", \"N31\": " << s.N31
+        << ", \"N2_LS\": " << s.N2_LS << ", \"N2_HS\": " << s.N2_HS
+        << ", \"N1_HS\": " << s.N1_HS << ", \"NC1_LS\": " << s.NC1_LS
+        << ", \"NC2_LS\": " << s.NC2_LS << "}\n";
+    break;
+
+  case output_format::csv:
+    if (!id.empty()) {
+      out << csv_escape(id) << ',';
+    }
+    out << s.fGPS << ',' << s.N31 << ',' << s.N2_LS << ',' << s.N2_HS << ','
+        << s.N1_HS << ',' << s.NC1_LS << ',' << s.NC2_LS << '\n';
+    break;
+
+  case output_format::binary:
+    for (auto v : {s.fGPS, s.N31, s.N1_HS, s.NC1_LS, s.NC2_LS, s.N2_HS,
+                   s.N2_LS}) {
+      out.put_le32(v);
+    }
+    break;
+  }
+
+  out.end_record();
+}
+
+void print_error(
+    std::string const& err, output_options const& opts, std::string const& id) {
+  if (opts.format == output_format::ndjson) {
+    stdout_buffer << "{\"id\": \"" << json_escape(id) << "\", \"error\": \""
+                  << json_escape(err) << "\"}\n";
+    stdout_buffer.end_record();
+  } else {
+    std::cerr << id << ": ERROR: " << err << std::endl;
+  }
+}
+
+struct batch_input {
+  std::string id;
+  std::string line;
+};
+
+struct batch_result {
+  std::string id;
+  std::vector<gpsdo_config::solution> solutions;
+  std::string error;
+  gpsdo_config::infeasibility reason{gpsdo_config::infeasibility::none};
+};
+
+std::string no_solutions_message(gpsdo_config::infeasibility reason) {
+  std::string msg = "no solutions found";
+
+  if (reason != gpsdo_config::infeasibility::none) {
+    msg += std::string(" (") + gpsdo_config::describe(reason) + ")";
+  }
+
+  return msg;
+}
+
+/**
+ * Print a batch or sweep result and return the corresponding exit status
+ */
+int print_result(batch_result const& res, output_options const& opts) {
+  if (!res.error.empty()) {
+    print_error(res.error, opts, res.id);
+    return 2;
+  }
+
+  if (res.solutions.empty()) {
+    print_error(no_solutions_message(res.reason), opts, res.id);
+    return 1;
+  }
+
+  for (auto const& s : res.solutions) {
+    print_solution(s, opts, res.id);
+  }
+
+  return 0;
+}
+
+/**
+ * Solve frequency pairs read from `is`, one pair per line
+ *
+ * Each line contains `[id:] f1 [f2]`. If no id is given, the line number
+ * is used. Empty lines and everything following a `#` are ignored.
+ *
+ * Input is read, solved and printed in windows of a bounded number of
+ * lines, so this works as a filter on an endless stream. A window also
+ * ends when no more input is available right away, so each line of an
+ * interactive stream is answered before the next one arrives.
+ */
+using solve_function = std::function<std::vector<gpsdo_config::solution>(
+    gpsdo_config::rat64, gpsdo_config::rat64)>;
+
+int gpsdo_batch(
+    std::istream& is,
+    gpsdo_config::hardware_limits const& limits,
+    solve_function const& solve,
+    unsigned threads,
+    output_options const& opts) {
+  using namespace gpsdo_config;
+
+  size_t constexpr WINDOW_PER_THREAD = 64;
+
+  auto const window = WINDOW_PER_THREAD * resolve_threads(threads);
+  std::vector<batch_input> inputs;
+  size_t lineno = 0;
+
+  // Only wait for more input if there's nothing to solve yet
+  auto more_input = [&] {
+    return inputs.empty()
+           or (inputs.size() < window and is.rdbuf()->in_avail() > 0);
+  };
+
+  auto read_window = [&] {
+    inputs.clear();
+
+    for (std::string line; more_input() and std::getline(is, line);) {
+      ++lineno;
+
+      if (auto pos = line.find('#'); pos != std::string::npos) {
+        line.erase(pos);
       }
-      decimal = true;
-    } else if (s == ' ' || s == '_') {
-      if (decimal or blank or frac) {
-        throw std::invalid_argument("invalid input");
+
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
       }
-      blank = true;
-      integral = num;
-      num = 0;
-    } else if (s == '/') {
-      if (decimal or frac) {
-        throw std::invalid_argument("invalid input");
+
+      inputs.push_back({std::to_string(lineno), line});
+    }
+
+    return !inputs.empty();
+  };
+
+  auto solve_input = [&](size_t i) {
+    auto const& in = inputs[i];
+    batch_result res;
+    res.id = in.id;
+
+    try {
+      std::istringstream iss(in.line);
+      std::vector<std::string> fields;
+
+      for (std::string f; iss >> f;) {
+        fields.emplace_back(std::move(f));
       }
-      frac = true;
-      den = 0;
-    } else if (s == 'k') {
-      if (unit != 1) {
-        throw std::invalid_argument("invalid input");
+
+      if (!fields.empty() and fields.front().back() == ':') {
+        res.id = fields.front().substr(0, fields.front().size() - 1);
+        fields.erase(fields.begin());
       }
-      unit = 1'000;
-    } else if (s == 'M') {
-      if (unit != 1) {
+
+      if (fields.empty() or fields.size() > 2) {
         throw std::invalid_argument("invalid input");
       }
-      unit = 1'000'000;
-    } else if (std::isdigit(s)) {
-      int dig = (s - '0');
 
-      if (frac) {
-        den = den * 10 + dig;
-      } else {
-        num = num * 10 + dig;
+      auto const f1 = parse_fraction(fields[0]);
+      auto const f2 = fields.size() > 1 ? parse_fraction(fields[1]) : f1;
 
-        if (decimal) {
-          den *= 10;
-        }
+      res.solutions = solve(f1, f2);
+
+      if (res.solutions.empty()) {
+        res.reason = check_feasibility(f1, f2, limits);
       }
-    } else {
-      throw std::invalid_argument("invalid input");
+    } catch (std::exception const& e) {
+      res.error = e.what();
+    }
+
+    return res;
+  };
+
+  auto const start = std::chrono::steady_clock::now();
+  size_t count = 0;
+  int rv = 0;
+
+  print_header(opts, true);
+
+  while (read_window()) {
+    ordered_parallel(
+        inputs.size(), threads, solve_input, [&](batch_result const& res) {
+          rv = std::max(rv, print_result(res, opts));
+        });
+
+    count += inputs.size();
+
+    // Don't hold back results while waiting for more input
+    stdout_buffer.flush();
+  }
+
+  if (opts.verbose) {
+    std::chrono::duration<double> const elapsed
+        = std::chrono::steady_clock::now() - start;
+    std::cerr << "solved " << count << " input(s) in " << elapsed.count()
+              << "s (" << count / std::max(elapsed.count(), 1e-9)
+              << " pairs/s)" << std::endl;
+  }
+
+  return rv;
+}
+
+// More points than anyone would want to wait for, and enough to catch
+// ranges whose step was mistyped
+size_t constexpr SWEEP_POINTS_MAX = 10'000'000;
+
+struct sweep_range {
+  gpsdo_config::rat64 start;
+  gpsdo_config::rat64 end;
+  gpsdo_config::rat64 step;
+  size_t points{0};
+};
+
+sweep_range parse_sweep_range(std::string const& str) {
+  auto const c1 = str.find(':');
+  auto const c2 = c1 == std::string::npos ? c1 : str.find(':', c1 + 1);
+
+  if (c2 == std::string::npos) {
+    throw std::invalid_argument("sweep range must be start:end:step");
+  }
+
+  sweep_range r{
+      .start = gpsdo_config::parse_fraction(str.substr(0, c1)),
+      .end = gpsdo_config::parse_fraction(str.substr(c1 + 1, c2 - c1 - 1)),
+      .step = gpsdo_config::parse_fraction(str.substr(c2 + 1)),
+  };
+
+  if (r.step <= 0 or r.end < r.start or r.start <= 0) {
+    throw std::invalid_argument("invalid sweep range");
+  }
+
+  // Also keeps start + step * p from overflowing for all points p
+  auto const steps = (r.end - r.start) / r.step;
+
+  if (steps >= static_cast<int64_t>(SWEEP_POINTS_MAX)) {
+    throw std::invalid_argument(
+        "sweep range has more than " + std::to_string(SWEEP_POINTS_MAX)
+        + " points");
+  }
+
+  r.points = boost::rational_cast<int64_t>(steps) + 1;
+
+  return r;
+}
+
+/**
+ * Parse cost model weights like "f3=1,vco=0.5"
+ *
+ * Weights that aren't given keep their defaults.
+ */
+gpsdo_config::cost_model parse_cost_model(std::string const& str) {
+  using gpsdo_config::cost_model;
+
+  static constexpr std::pair<std::string_view, double cost_model::*>
+      weights[] = {
+          {"f3", &cost_model::f3},
+          {"vco", &cost_model::vco_margin},
+          {"power", &cost_model::power},
+          {"gps", &cost_model::gps},
+      };
+
+  cost_model model;
+  std::string_view rest{str};
+
+  while (true) {
+    auto const item = rest.substr(0, rest.find(','));
+    auto const eq = item.find('=');
+    auto const it
+        = std::ranges::find(weights, item.substr(0, eq), [](auto const& w) {
+            return w.first;
+          });
+    double w;
+
+    if (eq == std::string_view::npos or it == std::end(weights)) {
+      throw std::invalid_argument("invalid cost weight: " + std::string(item));
     }
+
+    auto const [end, ec]
+        = std::from_chars(item.data() + eq + 1, item.data() + item.size(), w);
+
+    if (ec != std::errc{} or end != item.data() + item.size()
+        or !std::isfinite(w) or w < 0) {
+      throw std::invalid_argument("invalid cost weight: " + std::string(item));
+    }
+
+    model.*(it->second) = w;
+
+    if (item.size() == rest.size()) {
+      break;
+    }
+
+    rest.remove_prefix(item.size() + 1);
+  }
+
+  return model;
+}
+
+std::string format_frequency(gpsdo_config::rat64 f) {
+  auto str = std::to_string(f.numerator());
+  if (f.denominator() != 1) {
+    str += "/" + std::to_string(f.denominator());
+  }
+  return str;
+}
+
+/**
+ * Solve f1 together with every f2 in a sweep range
+ *
+ * Points are solved in chunks of consecutive f2 values, each by a single
+ * thread with its own solver for f1, so work done for one point can be
+ * reused for the following ones. Results are printed in order of f2 as
+ * soon as all previous points have been printed. The id of each result
+ * is its f2.
+ */
+using sweep_function = std::function<std::vector<gpsdo_config::solution>(
+    gpsdo_config::solver&, gpsdo_config::rat64)>;
+
+int gpsdo_sweep(
+    gpsdo_config::rat64 f1,
+    gpsdo_config::hardware_limits const& limits,
+    sweep_range const& range,
+    sweep_function const& solve,
+    unsigned threads,
+    output_options const& opts) {
+  using namespace gpsdo_config;
+
+  size_t constexpr CHUNK_SIZE = 16;
+
+  auto const points = range.points;
+  auto const chunks = (points + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  auto const start = std::chrono::steady_clock::now();
+  int rv = 0;
+
+  print_header(opts, true);
+
+  ordered_parallel(
+      chunks, threads,
+      [&](size_t i) {
+        solver sv(f1, limits);
+        std::vector<batch_result> results;
+
+        auto const end = std::min(points, (i + 1) * CHUNK_SIZE);
+
+        for (auto p = i * CHUNK_SIZE; p < end; ++p) {
+          auto const f2 = range.start + range.step * static_cast<int64_t>(p);
+          auto& res = results.emplace_back();
+          res.id = format_frequency(f2);
+
+          try {
+            res.solutions = solve(sv, f2);
+
+            if (res.solutions.empty()) {
+              res.reason = check_feasibility(f1, f2, limits);
+            }
+          } catch (std::exception const& e) {
+            res.error = e.what();
+          }
+        }
+
+        return results;
+      },
+      [&](std::vector<batch_result> const& results) {
+        for (auto const& res : results) {
+          rv = std::max(rv, print_result(res, opts));
+        }
+      });
+
+  if (opts.verbose) {
+    std::chrono::duration<double> const elapsed
+        = std::chrono::steady_clock::now() - start;
+    std::cerr << "solved " << points << " point(s) in " << elapsed.count()
+              << "s (" << points / std::max(elapsed.count(), 1e-9)
+              << " points/s)" << std::endl;
   }
 
-  if (den == 0) {
-    throw std::invalid_argument("invalid input");
+  return rv;
+}
+
+// An option understood by parse_simple_args(), either a switch or an
+// option whose value is the next argument
+struct simple_option {
+  std::string_view name;
+  std::string_view alias;
+  std::variant<bool*, unsigned*, size_t*, std::string*> target;
+  bool seen{false};
+};
+
+/**
+ * Parse the common form of command line without boost::program_options
+ *
+ * This only accepts up to two positional arguments and the exact names in
+ * `options`. Anything else, including any error, makes it return `false`,
+ * after which the command line must be parsed by program_options, which
+ * will overwrite all targets set here. Values starting with `-` are not
+ * accepted, so both parsers always split the command line the same way.
+ */
+bool parse_simple_args(int argc, char** argv,
+                       std::span<simple_option> options,
+                       std::span<std::string* const> positional) {
+  size_t num_positional = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg(argv[i]);
+
+    if (!arg.starts_with('-')) {
+      if (num_positional == positional.size()) {
+        return false;
+      }
+
+      *positional[num_positional++] = arg;
+      continue;
+    }
+
+    auto opt = std::ranges::find_if(options, [&](auto const& o) {
+      return arg == o.name or arg == o.alias;
+    });
+
+    if (opt == options.end() or std::exchange(opt->seen, true)) {
+      return false;
+    }
+
+    auto const parsed = std::visit(
+        [&](auto* target) {
+          using T = std::remove_pointer_t<decltype(target)>;
+
+          if constexpr (std::is_same_v<T, bool>) {
+            *target = true;
+            return true;
+          } else {
+            if (i + 1 == argc or argv[i + 1][0] == '-') {
+              return false;
+            }
+
+            std::string_view const value(argv[++i]);
+
+            if constexpr (std::is_same_v<T, std::string>) {
+              *target = value;
+              return true;
+            } else {
+              auto const end = value.data() + value.size();
+              auto [ptr, ec] = std::from_chars(value.data(), end, *target);
+              return ec == std::errc() and ptr == end;
+            }
+          }
+        },
+        opt->target);
+
+    if (!parsed) {
+      return false;
+    }
   }
 
-  return (gpsdo_config::rat64(num, den) + integral) * unit;
+  return true;
 }
 
 void gpsdo_usage(
@@ -99,6 +685,10 @@ void gpsdo_usage(
      << "numbers internally, and can also be specified as such. An integral\n"
      << "part can be separated from a fraction by either a single space or an\n"
      << "underscore. Suffixes `M` and `k` are supported for MHz and kHz.\n\n"
+     << "`--stream` prints solutions in search order as soon as they are\n"
+     << "found, without buffering and sorting them first. With `--sorted`,\n"
+     << "solutions are printed in the order of `--all`, with the first\n"
+     << "ones printed long before the search is complete.\n\n"
      << "`--all` and `--best` can be really slow as there may be millions\n"
      << "of possible solutions. By default, the code will look for a \"good\"\n"
      << "solution, which shouldn't be significantly slower than `--any`.\n"
@@ -106,19 +696,69 @@ void gpsdo_usage(
      << "phase detector comparison frequency (f3), which directly impacts\n"
      << "jitter/phase noise. `--best` will always search for the solution\n"
      << "with the highest possible f3. The default behaviour will accept\n"
-     << "any f3 that is higher than 50% of the maximum value.\n\n"
+     << "any f3 that is higher than 50% of the maximum value. `--top N`\n"
+     << "returns the first N solutions `--all` would return, but is much\n"
+     << "faster and only needs to keep N solutions in memory.\n\n"
+     << "The search can be spread across multiple threads using `--threads`.\n"
+     << "The results do not depend on the number of threads.\n\n"
+     << "`--batch` reads one frequency pair per line, formatted as\n"
+     << "`[id:] f1 [f2]`, and solves all pairs in a single process. Use an\n"
+     << "underscore to separate an integral part from a fraction. Each\n"
+     << "output record is prefixed with (or, for `--json`, contains) the id,\n"
+     << "which defaults to the line number. With `--threads`, multiple pairs\n"
+     << "are solved in parallel, but output is always in input order.\n"
+     << "Results are printed as input arrives, so `--batch` also works as a\n"
+     << "filter on a pipe.\n\n"
+     << "`--sweep start:end:step` solves f1 together with each f2 from\n"
+     << "start to end (inclusive) in increments of step, which can all be\n"
+     << "rational numbers. Output is like `--batch`, using f2 as the id, and\n"
+     << "is printed in order while later points are still being solved.\n"
+     << "A sweep can have at most " << SWEEP_POINTS_MAX << " points.\n\n"
      << "Output for `--json` and `--cmdline` will always be exclusively\n"
      << "written to stdout, suitable for processing by other commands.\n"
      << "All other output will be written to stderr.\n\n"
+     << "`--format` selects the output format. `cmdline` and `ndjson` are\n"
+     << "the same as `--cmdline` and `--json`, `csv` prints a header line\n"
+     << "followed by one line per solution. `binary` writes a 16 byte\n"
+     << "header (\"GPSDOSOL\", then version and record size as uint32)\n"
+     << "followed by one record of seven uint32 per solution, in the order\n"
+     << "fGPS, N31, N1_HS, NC1_LS, NC2_LS, N2_HS, N2_LS. All binary values\n"
+     << "are little-endian. Output to stdout is buffered unless it is a\n"
+     << "terminal.\n\n"
+     << "`--cost` ranks the solutions of `--best`, `--top`, `--all` and\n"
+     << "`--stream --sorted` by a weighted sum of costs instead of by f3\n"
+     << "alone. The weights are given as a comma separated list for `f3`\n"
+     << "(distance from the highest f3), `vco` (closeness of fOSC to the\n"
+     << "VCO limits), `power` (smaller high-speed dividers) and `gps`\n"
+     << "(distance of fGPS from the highest GPS frequency), e.g.\n"
+     << "`--cost f3=1,vco=0.5`. Weights that aren't given are 0, except\n"
+     << "for `f3`, which is 1.\n\n"
+     << "`--cache` keeps results in a file that is shared between runs and\n"
+     << "processes. Pairs that have been solved before with the same mode\n"
+     << "and limits will be returned from the cache without searching.\n\n"
+     << "`--index` looks up pairs in an index generated by `gpsdo-index`\n"
+     << "before searching. It is only used with `--best`.\n\n"
+     << "`--timeout-ms N` bounds the time spent on each search. A search\n"
+     << "that takes longer returns the best solutions found so far and\n"
+     << "prints a warning, as they may not be the best (or all) solutions.\n"
+     << "Timed out results are never stored in the cache.\n\n"
+     << "`--stats` prints counters describing the work done by the search\n"
+     << "to stderr, which helps finding out why a search is slow. With\n"
+     << "`--json`, they are printed as a single json object.\n\n"
      << "Examples:\n"
      << "  " << prog << " 1000\n"
      << "  " << prog << " 10M 96k\n"
      << "  " << prog << " 1000.31 2345.61 --best\n"
+     << "  " << prog << " 450 675 --top 10\n"
+     << "  " << prog << " 10M 120M --best --cost f3=1,power=0.5\n"
      << "  " << prog << " 10_1/7k 500/9k --all --verbose\n"
+     << "  " << prog << " --batch plans.txt --json -j 0\n"
+     << "  " << prog << " 10M --sweep 1M:2M:10k --cmdline -j 0\n"
      << "  lb-gps-linux /dev/hidraw3 $(" << prog << " 10M 120M --cmdline)\n\n"
      << "Exit status:\n"
      << "  0: successful completion\n"
      << "  1: could not find any solution for the specified frequencies\n"
+     << "     (for `--batch`: for at least one of the inputs)\n"
      << "  2: input processing error\n\n";
 }
 
@@ -126,131 +766,374 @@ int gpsdo_main(int argc, char** argv) {
   using namespace gpsdo_config;
 
   bool find_all = false, find_any = false, find_best = false, verbose = false,
-       cmdline = false, json = false, relaxed = false;
-  std::string f1_str, f2_str;
-
-  po::options_description desc("Options");
-  // clang-format off
-  desc.add_options()
-      ("f1", po::value<std::string>(&f1_str), "frequency 1")
-      ("f2", po::value<std::string>(&f2_str), "frequency 2")
-      ("all", po::bool_switch(&find_all), "find all possible solutions")
-      ("any", po::bool_switch(&find_any), "find any possible solution")
-      ("best", po::bool_switch(&find_best), "find best possible solution")
-      ("verbose,v", po::bool_switch(&verbose), "print more information")
-      ("relaxed", po::bool_switch(&relaxed), "use relaxed VCO limits")
-      ("cmdline", po::bool_switch(&cmdline), "print command line config")
-      ("json", po::bool_switch(&json), "print solutions as json objects")
-      ("help,h", "produce help message");
-  // clang-format on
+       cmdline = false, json = false, relaxed = false, stream = false,
+       sorted = false, stats = false;
+  unsigned threads = 1, timeout_ms = 0;
+  size_t top = 0;
+  std::string f1_str, f2_str, batch_file, cache_file, index_file, sweep_str,
+      format_str, cost_str;
+  bool find_top = false;
+
+  auto describe = [&](po::options_description& desc) {
+    // clang-format off
+    desc.add_options()
+        ("f1", po::value<std::string>(&f1_str), "frequency 1")
+        ("f2", po::value<std::string>(&f2_str), "frequency 2")
+        ("all", po::bool_switch(&find_all), "find all possible solutions")
+        ("any", po::bool_switch(&find_any), "find any possible solution")
+        ("best", po::bool_switch(&find_best), "find best possible solution")
+        ("top", po::value<size_t>(&top), "find the N best solutions")
+        ("stream", po::bool_switch(&stream), "like --all, but print unsorted "
+                                             "solutions as they are found")
+        ("sorted", po::bool_switch(&sorted),
+            "with --stream, print solutions in the order of --all")
+        ("cost", po::value<std::string>(&cost_str),
+            "rank solutions by weighted cost (f3, vco, power, gps)")
+        ("verbose,v", po::bool_switch(&verbose), "print more information")
+        ("relaxed", po::bool_switch(&relaxed), "use relaxed VCO limits")
+        ("threads,j", po::value<unsigned>(&threads)->default_value(1),
+            "number of search threads (0 = one per core)")
+        ("cmdline", po::bool_switch(&cmdline), "print command line config")
+        ("json", po::bool_switch(&json), "print solutions as json objects")
+        ("format", po::value<std::string>(&format_str),
+            "output format (text, cmdline, ndjson, csv, binary)")
+        ("batch", po::value<std::string>(&batch_file)->implicit_value("-"),
+            "solve frequency pairs from file (default: stdin)")
+        ("sweep", po::value<std::string>(&sweep_str),
+            "solve f1 with each f2 in start:end:step")
+        ("cache", po::value<std::string>(&cache_file),
+            "look up and store solutions in cache file")
+        ("index", po::value<std::string>(&index_file),
+            "look up best solutions in index file")
+        ("stats", po::bool_switch(&stats), "print search statistics")
+        ("timeout-ms", po::value<unsigned>(&timeout_ms),
+            "stop each search after this many milliseconds")
+        ("help,h", "produce help message");
+    // clang-format on
+  };
+
+  auto usage = [&](std::ostream& os) {
+    po::options_description desc("Options");
+    describe(desc);
+    gpsdo_usage(os, argv[0], desc);
+  };
 
   auto error = [&](std::string const& err) {
     std::cerr << "ERROR: " << err << "\n\n";
-    gpsdo_usage(std::cerr, argv[0], desc);
+    usage(std::cerr);
   };
 
-  po::positional_options_description pos;
-  pos.add("f1", 1);
-  pos.add("f2", 1);
+  // Most invocations only use a few options, and parsing them directly
+  // avoids a noticeable part of the startup time for fast searches.
+  simple_option simple[] = {
+      {"--all", {}, &find_all},         {"--any", {}, &find_any},
+      {"--best", {}, &find_best},       {"--top", {}, &top},
+      {"--stream", {}, &stream},        {"--sorted", {}, &sorted},
+      {"--cost", {}, &cost_str},        {"--verbose", "-v", &verbose},
+      {"--relaxed", {}, &relaxed},      {"--threads", "-j", &threads},
+      {"--cmdline", {}, &cmdline},      {"--json", {}, &json},
+      {"--format", {}, &format_str},    {"--sweep", {}, &sweep_str},
+      {"--cache", {}, &cache_file},     {"--index", {}, &index_file},
+      {"--stats", {}, &stats},          {"--timeout-ms", {}, &timeout_ms},
+  };
+  std::string* const positional[] = {&f1_str, &f2_str};
 
-  po::variables_map vm;
+  if (parse_simple_args(argc, argv, simple, positional)) {
+    find_top = std::ranges::find(simple, "--top", &simple_option::name)->seen;
+  } else {
+    po::options_description desc("Options");
+    describe(desc);
 
-  try {
-    po::store(
-        po::command_line_parser(argc, argv).options(desc).positional(pos).run(),
-        vm);
-  } catch (std::exception const& e) {
-    error(e.what());
+    po::positional_options_description pos;
+    pos.add("f1", 1);
+    pos.add("f2", 1);
+
+    po::variables_map vm;
+
+    try {
+      po::store(po::command_line_parser(argc, argv)
+                    .options(desc)
+                    .positional(pos)
+                    .run(),
+                vm);
+    } catch (std::exception const& e) {
+      error(e.what());
+      return 2;
+    }
+
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      gpsdo_usage(std::cout, argv[0], desc);
+      return 0;
+    }
+
+    find_top = vm.count("top");
+  }
+
+  if (batch_file.empty() and f1_str.empty()) {
+    error("at least one frequency must be specified");
     return 2;
   }
 
-  po::notify(vm);
+  if (!batch_file.empty() and (!f1_str.empty() or stream)) {
+    error("--batch cannot be combined with frequencies or --stream");
+    return 2;
+  }
 
-  if (vm.count("help")) {
-    gpsdo_usage(std::cout, argv[0], desc);
-    return 0;
+  std::optional<sweep_range> sweep;
+
+  if (!sweep_str.empty()) {
+    if (!batch_file.empty() or !f2_str.empty() or stream) {
+      error("--sweep cannot be combined with f2, --batch or --stream");
+      return 2;
+    }
+
+    try {
+      sweep = parse_sweep_range(sweep_str);
+    } catch (std::exception const& e) {
+      error(e.what());
+      return 2;
+    }
   }
 
-  if (f1_str.empty()) {
-    error("at least one frequency must be specified");
+  if ((find_all + find_any + find_best + find_top + stream) > 1) {
+    error("only one of --any, --best, --top, --all, --stream can be "
+          "specified");
+    return 2;
+  }
+
+  if (sorted and !stream) {
+    error("--sorted requires --stream");
+    return 2;
+  }
+
+  if (find_top and top == 0) {
+    error("--top must be at least 1");
     return 2;
   }
 
-  if ((find_all + find_any + find_best) > 1) {
-    error("only one of --any, --best, --all can be specified");
+  if ((cmdline + json + !format_str.empty()) > 1) {
+    error("only one of --cmdline, --json, --format can be specified");
     return 2;
   }
 
-  if ((cmdline + json) > 1) {
-    error("only one of --cmdline, --json can be specified");
+  auto format = cmdline ? output_format::cmdline
+                : json  ? output_format::ndjson
+                        : output_format::text;
+
+  if (!format_str.empty()) {
+    static constexpr std::pair<std::string_view, output_format> formats[] = {
+        {"text", output_format::text},     {"cmdline", output_format::cmdline},
+        {"ndjson", output_format::ndjson}, {"csv", output_format::csv},
+        {"binary", output_format::binary},
+    };
+
+    auto it = std::ranges::find(formats, format_str, [](auto const& f) {
+      return f.first;
+    });
+
+    if (it == std::end(formats)) {
+      error("unknown output format: " + format_str);
+      return 2;
+    }
+
+    format = it->second;
+  }
+
+  if (format == output_format::binary and (!batch_file.empty() or sweep)) {
+    error("--format binary cannot be combined with --batch or --sweep");
+    return 2;
+  }
+
+  std::optional<cost_model> cost;
+
+  if (!cost_str.empty()) {
+    if (!(find_best or find_top or find_all or sorted)) {
+      error("--cost requires --best, --top, --all or --stream --sorted");
+      return 2;
+    }
+
+    if (!cache_file.empty() or !index_file.empty()) {
+      error("--cost cannot be combined with --cache or --index");
+      return 2;
+    }
+
+    try {
+      cost = parse_cost_model(cost_str);
+    } catch (std::exception const& e) {
+      error(e.what());
+      return 2;
+    }
+  }
+
+  auto const& lim = relaxed ? si53xx_relaxed_limits : si53xx_limits;
+  auto const algorithm = find_all    ? find::all
+                         : find_any  ? find::any
+                         : find_best ? find::best
+                         : find_top  ? find::top_k
+                                     : find::good;
+  output_options const opts{.verbose = verbose, .format = format};
+
+  if ((stats or timeout_ms > 0) and stream) {
+    error("--stats and --timeout-ms cannot be combined with --stream");
     return 2;
   }
 
+  std::optional<solution_cache> cache;
+
+  if (!cache_file.empty()) {
+    if (stream) {
+      error("--cache cannot be combined with --stream");
+      return 2;
+    }
+
+    cache.emplace(cache_file);
+  }
+
+  // The index only contains results for find::best.
+  std::optional<solution_index> index;
+
+  if (!index_file.empty() and algorithm == find::best) {
+    index.emplace(index_file);
+  }
+
+  // Statistics are summed up across all searches, i.e. all inputs in
+  // batch mode. Results returned from the cache don't contribute.
+  solver_stats total_stats;
+  std::mutex stats_mx;
+
+  auto print_stats = [&] {
+    if (stats) {
+      total_stats.write(std::cerr, format == output_format::ndjson);
+      std::cerr << std::endl;
+    }
+  };
+
+  auto solve = [&](rat64 f1, rat64 f2, unsigned threads,
+                   solver* sv = nullptr) {
+    if (index) {
+      if (auto indexed = index->lookup(f1, f2, lim)) {
+        return std::move(*indexed);
+      }
+    }
+
+    solver_stats st;
+    bool timed_out = false;
+    search_options const options{
+        .threads = threads,
+        .top_k = top,
+        .stats = stats ? &st : nullptr,
+        .timeout = std::chrono::milliseconds(timeout_ms),
+        .timed_out = &timed_out,
+        .cost = cost ? &*cost : nullptr,
+    };
+    auto rv = cache ? cache->find_solutions(f1, f2, lim, algorithm, options)
+              : sv  ? sv->find_solutions(f2, algorithm, options)
+                    : find_solutions(f1, f2, lim, algorithm, options);
+    std::lock_guard lock(stats_mx);
+    if (stats) {
+      total_stats += st;
+    }
+    if (timed_out) {
+      std::cerr << "WARNING: search for " << format_frequency(f1) << " "
+                << format_frequency(f2)
+                << " timed out, solutions may not be the best" << std::endl;
+    }
+    return rv;
+  };
+
+  if (!batch_file.empty()) {
+    // Parallelism is across inputs rather than within a single search.
+    auto solve_one = [&](rat64 f1, rat64 f2) { return solve(f1, f2, 1); };
+    int rv;
+
+    if (batch_file == "-") {
+      rv = gpsdo_batch(std::cin, lim, solve_one, threads, opts);
+    } else {
+      std::ifstream ifs(batch_file);
+
+      if (!ifs) {
+        error("cannot open " + batch_file);
+        return 2;
+      }
+
+      rv = gpsdo_batch(ifs, lim, solve_one, threads, opts);
+    }
+
+    print_stats();
+
+    return rv;
+  }
+
   rat64 f1, f2;
 
   f1 = parse_fraction(f1_str);
 
+  if (sweep) {
+    // As with --batch, parallelism is across points.
+    auto solve_point = [&](solver& sv, rat64 f2) {
+      return solve(f1, f2, 1, &sv);
+    };
+
+    auto rv = gpsdo_sweep(f1, lim, *sweep, solve_point, threads, opts);
+
+    print_stats();
+
+    return rv;
+  }
+
   if (f2_str.empty()) {
     f2 = f1;
   } else {
     f2 = parse_fraction(f2_str);
   }
 
-  hardware_limits const limits{
-      // Source: Silicon Labs Si53xx-RM Rev. 1.3, Table 26
-      .VCO_LO = 4'850'000'000,
-      .VCO_HI = 5'670'000'000,
-      .F3_LO = 2'000,
-      .F3_HI = 2'000'000,
+  print_header(opts, false);
 
-      // Source: ublox MAX-M8 series data sheet
-      .GPS_HI = 10'000'000,
-  };
+  if (stream) {
+    size_t count = 0;
+    auto visitor = [&](solution const& s) {
+      print_solution(s, opts);
+      ++count;
+      return true;
+    };
 
-  hardware_limits const relaxed_limits{
-      // Source: lb-gps-linux source code
-      .VCO_LO = 3'500'000'000,
-      .VCO_HI = 6'500'000'000,
-      .F3_LO = 2'000,
-      .F3_HI = 2'000'000,
+    if (sorted) {
+      for_each_sorted_solution(f1, f2, lim, visitor,
+                               {.threads = threads,
+                                .cost = cost ? &*cost : nullptr});
+    } else {
+      for_each_solution(f1, f2, lim, visitor);
+    }
 
-      // Source: ublox MAX-M8 series data sheet
-      .GPS_HI = 10'000'000,
-  };
+    if (count == 0) {
+      std::cerr << no_solutions_message(check_feasibility(f1, f2, lim))
+                << std::endl;
+      return 1;
+    }
 
-  auto solutions = find_solutions(
-      f1, f2, relaxed ? relaxed_limits : limits,
-      find_all    ? find::all
-      : find_any  ? find::any
-      : find_best ? find::best
-                  : find::good);
+    std::cerr << "found " << count << " solution(s)" << std::endl;
+
+    return 0;
+  }
+
+  auto solutions = solve(f1, f2, threads);
+
+  print_stats();
 
   if (solutions.empty()) {
-    std::cerr << "no solutions found" << std::endl;
+    std::cerr << no_solutions_message(check_feasibility(f1, f2, lim))
+              << std::endl;
     return 1;
   }
 
-  if (verbose or find_all) {
+  if (verbose or find_all or find_top) {
     std::cerr << "found " << solutions.size() << " solution(s)" << std::endl;
   }
 
   for (auto const& s : solutions) {
-    if (verbose or (!cmdline and !json)) {
-      s.write(std::cerr, verbose);
-      std::cerr << std::endl;
-    }
-    if (cmdline) {
-      std::cout << "--gps " << s.fGPS << " --n31 " << s.N31 << " --n2_ls "
-                << s.N2_LS << " --n2_hs " << s.N2_HS << " --n1_hs " << s.N1_HS
-                << " --nc1_ls " << s.NC1_LS << " --nc2_ls " << s.NC2_LS
-                << std::endl;
-    }
-    if (json) {
-      std::cout << "{\"fGPS\": " << s.fGPS << ", \"N31\": " << s.N31
-                << ", \"N2_LS\": " << s.N2_LS << ", \"N2_HS\": " << s.N2_HS
-                << ", \"N1_HS\": " << s.N1_HS << ", \"NC1_LS\": " << s.NC1_LS
-                << ", \"NC2_LS\": " << s.NC2_LS << "}" << std::endl;
-    }
+    print_solution(s, opts);
   }
 
   return 0;
@@ -259,6 +1142,10 @@ int gpsdo_main(int argc, char** argv) {
 } // namespace
 
 int main(int argc, char** argv) {
+  // Only iostreams are used, and without stdio synchronization, std::cin
+  // can tell how much input is available, see gpsdo_batch()
+  std::ios::sync_with_stdio(false);
+
   try {
     return gpsdo_main(argc, argv);
   } catch (std::exception const& e) {
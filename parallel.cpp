@@ -0,0 +1,83 @@
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "parallel.h"
+
+#include <utility>
+
+namespace gpsdo_config {
+
+unsigned resolve_threads(unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  return threads;
+}
+
+thread_pool::thread_pool(unsigned threads) {
+  for (unsigned i = 0; i < resolve_threads(threads); ++i) {
+    workers_.emplace_back([this] { run(); });
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard lock(mx_);
+    done_ = true;
+  }
+
+  cv_.notify_all();
+
+  for (auto& t : workers_) {
+    t.join();
+  }
+}
+
+void thread_pool::submit(std::function<void()> job) {
+  {
+    std::lock_guard lock(mx_);
+    jobs_.push_back(std::move(job));
+  }
+
+  cv_.notify_one();
+}
+
+void thread_pool::run() {
+  for (;;) {
+    std::function<void()> job;
+
+    {
+      std::unique_lock lock(mx_);
+      cv_.wait(lock, [this] { return done_ or !jobs_.empty(); });
+
+      if (jobs_.empty()) {
+        return;
+      }
+
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    job();
+  }
+}
+
+} // namespace gpsdo_config
@@ -0,0 +1,141 @@
+#pragma once
+
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace gpsdo_config {
+
+// Number of threads to use when asked for `threads`, 0 means one per core
+unsigned resolve_threads(unsigned threads);
+
+/**
+ * Call `fn(i)` for all `i` in [0, count) using `threads` threads
+ *
+ * Indices are handed out dynamically, so threads that finish early will
+ * pick up more work. The calling thread is one of the threads. The first
+ * exception thrown by `fn` is rethrown once all threads have finished.
+ */
+template <typename Fn>
+void parallel_for(size_t count, unsigned threads, Fn const& fn) {
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mx;
+
+  auto worker = [&] {
+    try {
+      for (size_t i; (i = next.fetch_add(1)) < count;) {
+        fn(i);
+      }
+    } catch (...) {
+      std::lock_guard lock(error_mx);
+      if (!error) {
+        error = std::current_exception();
+      }
+      next = count;
+    }
+  };
+
+  std::vector<std::thread> pool;
+
+  for (unsigned t = 1; t < std::min<size_t>(resolve_threads(threads), count);
+       ++t) {
+    pool.emplace_back(worker);
+  }
+
+  worker();
+
+  for (auto& t : pool) {
+    t.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/**
+ * Call `produce(i)` for all `i` in [0, count) using `threads` threads
+ * and pass the results to `consume` in order of `i`, as soon as all
+ * previous results have been consumed.
+ */
+template <typename Produce, typename Consume>
+void ordered_parallel(
+    size_t count,
+    unsigned threads,
+    Produce const& produce,
+    Consume const& consume) {
+  using result_type = std::invoke_result_t<Produce, size_t>;
+
+  std::vector<std::optional<result_type>> results(count);
+  std::mutex mx;
+  size_t consumed = 0;
+
+  parallel_for(count, threads, [&](size_t i) {
+    auto r = produce(i);
+    std::lock_guard lock(mx);
+    results[i].emplace(std::move(r));
+    while (consumed < count and results[consumed]) {
+      consume(*results[consumed]);
+      results[consumed].reset();
+      ++consumed;
+    }
+  });
+}
+
+/**
+ * A fixed number of threads running jobs in the order they are submitted
+ */
+class thread_pool {
+ public:
+  explicit thread_pool(unsigned threads);
+
+  // Finishes all submitted jobs
+  ~thread_pool();
+
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  void submit(std::function<void()> job);
+
+ private:
+  void run();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+  std::mutex mx_;
+  std::condition_variable cv_;
+  bool done_{false};
+};
+
+} // namespace gpsdo_config
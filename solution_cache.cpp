@@ -0,0 +1,378 @@
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "solution_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gpsdo_config {
+
+namespace {
+
+//
+// File layout (native byte order):
+//
+//   header:  char[8] magic
+//   record:  int64_t[10] key, uint32_t count, uint32_t reserved,
+//            uint32_t[7] solution * count
+//
+// Records are only ever appended with a single write(), so a reader will
+// at worst see a truncated last record, which is ignored. A record that is
+// still truncated when the cache is opened was left behind by a writer
+// that died, and is cut off so new records don't get appended to it.
+//
+char const MAGIC[8] = {'G', 'P', 'S', 'D', 'O', 'S', 'C', '\x01'};
+
+size_t constexpr KEY_SIZE = 10 * sizeof(int64_t);
+size_t constexpr RECORD_HEADER_SIZE = KEY_SIZE + 2 * sizeof(uint32_t);
+size_t constexpr SOLUTION_SIZE = 7 * sizeof(uint32_t);
+
+void swap_outputs(std::vector<solution>& solutions) {
+  for (auto& s : solutions) {
+    std::swap(s.NC1_LS, s.NC2_LS);
+  }
+}
+
+void write_all(int fd, std::vector<char> const& buf) {
+  // With O_APPEND, a single write() of the whole record keeps concurrent
+  // writers from interleaving their records.
+  auto rv = ::write(fd, buf.data(), buf.size());
+
+  if (rv < 0) {
+    throw std::system_error(errno, std::generic_category(), "write");
+  }
+
+  if (static_cast<size_t>(rv) != buf.size()) {
+    throw std::runtime_error("short write to solution cache");
+  }
+}
+
+// Exclusive advisory lock on a file, held while creating its header,
+// dropping a truncated record or appending a record
+class file_lock {
+ public:
+  explicit file_lock(int fd)
+      : fd_{fd} {
+    while (::flock(fd_, LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        throw std::system_error(errno, std::generic_category(), "flock");
+      }
+    }
+  }
+  ~file_lock() { ::flock(fd_, LOCK_UN); }
+
+  file_lock(file_lock const&) = delete;
+  file_lock& operator=(file_lock const&) = delete;
+
+ private:
+  int const fd_;
+};
+
+} // namespace
+
+solution_cache::solution_cache(std::string const& path) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+
+  try {
+    // Without the lock, two processes creating the cache at the same time
+    // could both find it empty and both write the header.
+    file_lock const lock(fd_);
+    struct stat st;
+
+    if (::fstat(fd_, &st) != 0) {
+      throw std::system_error(errno, std::generic_category(), "fstat " + path);
+    }
+
+    if (st.st_size == 0) {
+      write_all(fd_, std::vector<char>(std::begin(MAGIC), std::end(MAGIC)));
+    }
+
+    refresh();
+
+    if (mapped_ < sizeof(MAGIC)
+        or std::memcmp(data_, MAGIC, sizeof(MAGIC)) != 0) {
+      throw std::runtime_error("not a solution cache: " + path);
+    }
+
+    if (scanned_ < mapped_) {
+      if (::ftruncate(fd_, scanned_) != 0) {
+        throw std::system_error(
+            errno, std::generic_category(), "ftruncate " + path);
+      }
+
+      unmap();
+      refresh();
+    }
+  } catch (...) {
+    unmap();
+    ::close(fd_);
+    throw;
+  }
+}
+
+solution_cache::~solution_cache() {
+  unmap();
+  ::close(fd_);
+}
+
+solution_cache::key solution_cache::make_key(
+    rat64 f1, rat64 f2, hardware_limits const& limits, find algorithm) {
+  static_assert(sizeof(key) == KEY_SIZE);
+
+  return {
+      .f1_num = f1.numerator(),
+      .f1_den = f1.denominator(),
+      .f2_num = f2.numerator(),
+      .f2_den = f2.denominator(),
+      .VCO_LO = limits.VCO_LO,
+      .VCO_HI = limits.VCO_HI,
+      .F3_LO = limits.F3_LO,
+      .F3_HI = limits.F3_HI,
+      .GPS_HI = limits.GPS_HI,
+      .algorithm = static_cast<int64_t>(algorithm),
+  };
+}
+
+void solution_cache::unmap() {
+  if (data_) {
+    ::munmap(data_, mapped_);
+    data_ = nullptr;
+    mapped_ = 0;
+  }
+}
+
+void solution_cache::refresh() {
+  struct stat st;
+
+  if (::fstat(fd_, &st) != 0) {
+    throw std::system_error(errno, std::generic_category(), "fstat");
+  }
+
+  auto const size = static_cast<size_t>(st.st_size);
+
+  if (size <= mapped_) {
+    return;
+  }
+
+  unmap();
+
+  data_ = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+
+  mapped_ = size;
+
+  auto const* p = static_cast<char const*>(data_);
+
+  if (scanned_ == 0) {
+    scanned_ = sizeof(MAGIC);
+  }
+
+  while (scanned_ + RECORD_HEADER_SIZE <= mapped_) {
+    key k;
+    uint32_t count;
+
+    std::memcpy(&k, p + scanned_, KEY_SIZE);
+    std::memcpy(&count, p + scanned_ + KEY_SIZE, sizeof(count));
+
+    auto const end = scanned_ + RECORD_HEADER_SIZE + count * SOLUTION_SIZE;
+
+    if (end > mapped_) {
+      break;
+    }
+
+    index_.insert_or_assign(
+        k, entry{.offset = scanned_ + RECORD_HEADER_SIZE, .count = count});
+
+    scanned_ = end;
+  }
+}
+
+std::optional<std::vector<solution>> solution_cache::lookup(
+    rat64 f1, rat64 f2, hardware_limits const& limits, find algorithm) {
+  bool const swapped = f2 < f1;
+
+  if (swapped) {
+    std::swap(f1, f2);
+  }
+
+  auto const k = make_key(f1, f2, limits, algorithm);
+
+  std::lock_guard lock(mx_);
+
+  auto it = index_.find(k);
+
+  if (it == index_.end()) {
+    // Another process may have added the entry in the meantime.
+    refresh();
+    it = index_.find(k);
+
+    if (it == index_.end()) {
+      return std::nullopt;
+    }
+  }
+
+  auto const* p = static_cast<char const*>(data_) + it->second.offset;
+  std::vector<solution> solutions(it->second.count);
+
+  for (auto& s : solutions) {
+    uint32_t v[7];
+    std::memcpy(v, p, sizeof(v));
+    s = {
+        .fGPS = v[0],
+        .N31 = v[1],
+        .N1_HS = v[2],
+        .NC1_LS = v[3],
+        .NC2_LS = v[4],
+        .N2_HS = v[5],
+        .N2_LS = v[6],
+    };
+    p += SOLUTION_SIZE;
+  }
+
+  if (swapped) {
+    swap_outputs(solutions);
+  }
+
+  return solutions;
+}
+
+void solution_cache::store(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    find algorithm,
+    std::vector<solution> const& solutions) {
+  bool const swapped = f2 < f1;
+
+  if (swapped) {
+    std::swap(f1, f2);
+  }
+
+  auto const k = make_key(f1, f2, limits, algorithm);
+  uint32_t const header[2] = {static_cast<uint32_t>(solutions.size()), 0};
+  std::vector<char> buf(
+      RECORD_HEADER_SIZE + solutions.size() * SOLUTION_SIZE);
+  auto* p = buf.data();
+
+  std::memcpy(p, &k, KEY_SIZE);
+  std::memcpy(p + KEY_SIZE, header, sizeof(header));
+  p += RECORD_HEADER_SIZE;
+
+  for (auto const& s : solutions) {
+    uint32_t const v[7] = {
+        s.fGPS,
+        s.N31,
+        s.N1_HS,
+        swapped ? s.NC2_LS : s.NC1_LS,
+        swapped ? s.NC1_LS : s.NC2_LS,
+        s.N2_HS,
+        s.N2_LS,
+    };
+    std::memcpy(p, v, sizeof(v));
+    p += SOLUTION_SIZE;
+  }
+
+  std::lock_guard lock(mx_);
+
+  // Opening the cache must not mistake a record that is still being
+  // written for one left behind truncated.
+  {
+    file_lock const append_lock(fd_);
+    write_all(fd_, buf);
+  }
+
+  refresh();
+}
+
+std::vector<solution> solution_cache::find_solutions(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    find algorithm,
+    search_options const& options) {
+  if (options.timed_out) {
+    *options.timed_out = false;
+  }
+
+  // The key doesn't include the cost model, so these can't be cached.
+  if (options.cost) {
+    return gpsdo_config::find_solutions(f1, f2, limits, algorithm, options);
+  }
+
+  if (algorithm == find::top_k) {
+    // The key doesn't include k, but the top k solutions are a prefix of
+    // all solutions, which may have been cached.
+    if (auto cached = lookup(f1, f2, limits, find::all)) {
+      if (options.top_k > 0) {
+        cached->resize(std::min(cached->size(), options.top_k));
+      }
+      return std::move(*cached);
+    }
+
+    return gpsdo_config::find_solutions(f1, f2, limits, algorithm, options);
+  }
+
+  if (auto cached = lookup(f1, f2, limits, algorithm)) {
+    return std::move(*cached);
+  }
+
+  bool timed_out = false;
+  auto opts = options;
+  opts.timed_out = &timed_out;
+
+  auto solutions
+      = gpsdo_config::find_solutions(f1, f2, limits, algorithm, opts);
+
+  // The results of an incomplete search must not be cached.
+  if (!timed_out) {
+    store(f1, f2, limits, algorithm, solutions);
+  } else if (options.timed_out) {
+    *options.timed_out = true;
+  }
+
+  return solutions;
+}
+
+size_t solution_cache::size() const {
+  std::lock_guard lock(mx_);
+  return index_.size();
+}
+
+} // namespace gpsdo_config
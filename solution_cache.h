@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "solver.h"
+
+namespace gpsdo_config {
+
+/**
+ * Persistent cache of find_solutions() results
+ *
+ * The cache is an append-only file that is memory-mapped for lookups and
+ * can be shared by multiple processes. Entries are keyed by the pair of
+ * frequencies, the hardware limits and the search algorithm. As swapping
+ * f1 and f2 merely swaps NC1_LS and NC2_LS in all solutions, both orders
+ * share the same entry.
+ *
+ * All member functions are thread-safe.
+ */
+class solution_cache {
+ public:
+  explicit solution_cache(std::string const& path);
+  ~solution_cache();
+
+  solution_cache(solution_cache const&) = delete;
+  solution_cache& operator=(solution_cache const&) = delete;
+
+  std::optional<std::vector<solution>> lookup(
+      rat64 f1, rat64 f2, hardware_limits const& limits, find algorithm);
+
+  void store(
+      rat64 f1,
+      rat64 f2,
+      hardware_limits const& limits,
+      find algorithm,
+      std::vector<solution> const& solutions);
+
+  // Return cached solutions or search and store them. Results for
+  // find::top_k are not stored, but are taken from find::all if cached.
+  // Searches with a cost model always bypass the cache.
+  std::vector<solution> find_solutions(
+      rat64 f1,
+      rat64 f2,
+      hardware_limits const& limits,
+      find algorithm = find::any,
+      search_options const& options = {});
+
+  size_t size() const;
+
+ private:
+  struct key {
+    int64_t f1_num;
+    int64_t f1_den;
+    int64_t f2_num;
+    int64_t f2_den;
+    int64_t VCO_LO;
+    int64_t VCO_HI;
+    int64_t F3_LO;
+    int64_t F3_HI;
+    int64_t GPS_HI;
+    int64_t algorithm;
+
+    auto operator<=>(key const&) const = default;
+  };
+
+  struct entry {
+    size_t offset;
+    uint32_t count;
+  };
+
+  static key make_key(
+      rat64 f1, rat64 f2, hardware_limits const& limits, find algorithm);
+  void refresh();
+  void unmap();
+
+  int fd_{-1};
+  void* data_{nullptr};
+  size_t mapped_{0};
+  size_t scanned_{0};
+  std::map<key, entry> index_;
+  mutable std::mutex mx_;
+};
+
+} // namespace gpsdo_config
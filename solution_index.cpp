@@ -0,0 +1,311 @@
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "solution_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gpsdo_config {
+
+namespace {
+
+//
+// File layout (native byte order):
+//
+//   header:  char[8] magic, uint32_t limits_count, uint32_t record_count,
+//            int64_t[5] hardware_limits * limits_count
+//   record:  int64_t[4] f1_num, f1_den, f2_num, f2_den,
+//            uint32_t limits, uint32_t found, uint32_t[7] solution
+//
+// Records are sorted by (limits, f1_num, f1_den, f2_num, f2_den), with
+// f1 <= f2. `limits` is an index into the header's hardware limits.
+//
+char const MAGIC[8] = {'G', 'P', 'S', 'D', 'O', 'I', 'X', '\x01'};
+
+size_t constexpr HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t);
+size_t constexpr LIMITS_SIZE = 5 * sizeof(int64_t);
+size_t constexpr RECORD_SIZE
+    = 4 * sizeof(int64_t) + 2 * sizeof(uint32_t) + 7 * sizeof(uint32_t);
+
+using record_key = std::tuple<uint32_t, int64_t, int64_t, int64_t, int64_t>;
+
+record_key read_key(char const* p) {
+  int64_t f[4];
+  uint32_t limits;
+  std::memcpy(f, p, sizeof(f));
+  std::memcpy(&limits, p + sizeof(f), sizeof(limits));
+  return {limits, f[0], f[1], f[2], f[3]};
+}
+
+} // namespace
+
+solution_index::solution_index(std::string const& path) {
+  auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+
+  struct stat st;
+
+  if (::fstat(fd, &st) != 0) {
+    auto const err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "fstat " + path);
+  }
+
+  mapped_ = static_cast<size_t>(st.st_size);
+
+  if (mapped_ > 0) {
+    data_ = ::mmap(nullptr, mapped_, PROT_READ, MAP_SHARED, fd, 0);
+  }
+
+  auto const err = errno;
+  ::close(fd);
+
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::system_error(err, std::generic_category(), "mmap " + path);
+  }
+
+  auto const* p = static_cast<char const*>(data_);
+  uint32_t counts[2] = {0, 0};
+
+  if (mapped_ >= HEADER_SIZE) {
+    std::memcpy(counts, p + sizeof(MAGIC), sizeof(counts));
+  }
+
+  auto const records = HEADER_SIZE + size_t{counts[0]} * LIMITS_SIZE;
+
+  if (mapped_ < HEADER_SIZE or std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0
+      or mapped_ != records + size_t{counts[1]} * RECORD_SIZE) {
+    if (data_) {
+      ::munmap(data_, mapped_);
+    }
+    throw std::runtime_error("invalid solution index: " + path);
+  }
+
+  for (uint32_t i = 0; i < counts[0]; ++i) {
+    int64_t v[5];
+    std::memcpy(v, p + HEADER_SIZE + i * LIMITS_SIZE, sizeof(v));
+    limits_.push_back({
+        .VCO_LO = v[0],
+        .VCO_HI = v[1],
+        .F3_LO = v[2],
+        .F3_HI = v[3],
+        .GPS_HI = v[4],
+    });
+  }
+
+  records_ = p + records;
+  count_ = counts[1];
+}
+
+solution_index::~solution_index() {
+  if (data_) {
+    ::munmap(data_, mapped_);
+  }
+}
+
+std::optional<std::vector<solution>> solution_index::lookup(
+    rat64 f1, rat64 f2, hardware_limits const& limits) const {
+  auto const lit = std::find(limits_.begin(), limits_.end(), limits);
+
+  if (lit == limits_.end()) {
+    return std::nullopt;
+  }
+
+  bool const swapped = f2 < f1;
+
+  if (swapped) {
+    std::swap(f1, f2);
+  }
+
+  record_key const key{
+      static_cast<uint32_t>(lit - limits_.begin()),
+      f1.numerator(),
+      f1.denominator(),
+      f2.numerator(),
+      f2.denominator(),
+  };
+
+  // Binary search over the fixed-size records
+  size_t lo = 0, hi = count_;
+
+  while (lo < hi) {
+    auto const mid = lo + (hi - lo) / 2;
+
+    if (read_key(records_ + mid * RECORD_SIZE) < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  auto const* p = records_ + lo * RECORD_SIZE;
+
+  if (lo == count_ or read_key(p) != key) {
+    return std::nullopt;
+  }
+
+  uint32_t found;
+  uint32_t v[7];
+  std::memcpy(
+      &found, p + 4 * sizeof(int64_t) + sizeof(uint32_t), sizeof(found));
+  std::memcpy(v, p + 4 * sizeof(int64_t) + 2 * sizeof(uint32_t), sizeof(v));
+
+  std::vector<solution> solutions;
+
+  if (found) {
+    solutions.push_back({
+        .fGPS = v[0],
+        .N31 = v[1],
+        .N1_HS = v[2],
+        .NC1_LS = swapped ? v[4] : v[3],
+        .NC2_LS = swapped ? v[3] : v[4],
+        .N2_HS = v[5],
+        .N2_LS = v[6],
+    });
+  }
+
+  return solutions;
+}
+
+size_t solution_index::write(
+    std::string const& path, std::vector<entry> entries) {
+  std::vector<hardware_limits> limits;
+  std::vector<std::pair<record_key, std::optional<solution>>> records;
+
+  for (auto& e : entries) {
+    if (e.f2 < e.f1) {
+      std::swap(e.f1, e.f2);
+      if (e.best) {
+        std::swap(e.best->NC1_LS, e.best->NC2_LS);
+      }
+    }
+
+    auto it = std::find(limits.begin(), limits.end(), e.limits);
+
+    if (it == limits.end()) {
+      it = limits.insert(limits.end(), e.limits);
+    }
+
+    records.emplace_back(
+        record_key{
+            static_cast<uint32_t>(it - limits.begin()),
+            e.f1.numerator(),
+            e.f1.denominator(),
+            e.f2.numerator(),
+            e.f2.denominator(),
+        },
+        e.best);
+  }
+
+  std::stable_sort(
+      records.begin(), records.end(),
+      [](auto const& a, auto const& b) { return a.first < b.first; });
+
+  // Keep only the last of any duplicate entries
+  auto last = std::unique(
+      records.rbegin(), records.rend(),
+      [](auto const& a, auto const& b) { return a.first == b.first; });
+  records.erase(records.begin(), last.base());
+
+  std::vector<char> buf(
+      HEADER_SIZE + limits.size() * LIMITS_SIZE
+      + records.size() * RECORD_SIZE);
+  auto* p = buf.data();
+  uint32_t const counts[2] = {
+      static_cast<uint32_t>(limits.size()),
+      static_cast<uint32_t>(records.size()),
+  };
+
+  std::memcpy(p, MAGIC, sizeof(MAGIC));
+  std::memcpy(p + sizeof(MAGIC), counts, sizeof(counts));
+  p += HEADER_SIZE;
+
+  for (auto const& l : limits) {
+    int64_t const v[5] = {l.VCO_LO, l.VCO_HI, l.F3_LO, l.F3_HI, l.GPS_HI};
+    std::memcpy(p, v, sizeof(v));
+    p += LIMITS_SIZE;
+  }
+
+  for (auto const& [key, best] : records) {
+    auto const [lim, f1_num, f1_den, f2_num, f2_den] = key;
+    int64_t const f[4] = {f1_num, f1_den, f2_num, f2_den};
+    uint32_t const hdr[2] = {lim, best ? 1U : 0U};
+    std::array<uint32_t, 7> v{};
+
+    if (best) {
+      v = {best->fGPS,   best->N31,   best->N1_HS, best->NC1_LS,
+           best->NC2_LS, best->N2_HS, best->N2_LS};
+    }
+
+    std::memcpy(p, f, sizeof(f));
+    std::memcpy(p + sizeof(f), hdr, sizeof(hdr));
+    std::memcpy(p + sizeof(f) + sizeof(hdr), v.data(), sizeof(v));
+    p += RECORD_SIZE;
+  }
+
+  auto const tmp = path + ".tmp";
+  auto const fd
+      = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "open " + tmp);
+  }
+
+  for (size_t off = 0; off < buf.size();) {
+    auto rv = ::write(fd, buf.data() + off, buf.size() - off);
+
+    if (rv < 0) {
+      auto const err = errno;
+      ::close(fd);
+      ::unlink(tmp.c_str());
+      throw std::system_error(err, std::generic_category(), "write " + tmp);
+    }
+
+    off += rv;
+  }
+
+  if (::close(fd) != 0 or std::rename(tmp.c_str(), path.c_str()) != 0) {
+    auto const err = errno;
+    ::unlink(tmp.c_str());
+    throw std::system_error(err, std::generic_category(), "write " + path);
+  }
+
+  return records.size();
+}
+
+} // namespace gpsdo_config
@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * GPSDO Configuration Library
+ *
+ * Copyright (c) Marcus Holland-Moritz (github@mhxnet.de)
+ *
+ * This file is part of gpsdo-config.
+ *
+ * gpsdo-config is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * gpsdo-config is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "solver.h"
+
+namespace gpsdo_config {
+
+/**
+ * Read-only index of precomputed find::best results
+ *
+ * The index is a file of fixed-size records sorted by frequency pair and
+ * hardware limits, generated offline by `gpsdo-index` for commonly used
+ * frequency plans. It is memory-mapped and searched with a binary search,
+ * so lookups are very cheap. Like in the solution cache, both orders of
+ * f1 and f2 share the same record.
+ *
+ * All member functions are thread-safe.
+ */
+class solution_index {
+ public:
+  struct entry {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits limits;
+    std::optional<solution> best;
+  };
+
+  explicit solution_index(std::string const& path);
+  ~solution_index();
+
+  solution_index(solution_index const&) = delete;
+  solution_index& operator=(solution_index const&) = delete;
+
+  // Returns std::nullopt if the pair is not in the index, or the result of
+  // find_solutions(f1, f2, limits, find::best) otherwise.
+  std::optional<std::vector<solution>>
+  lookup(rat64 f1, rat64 f2, hardware_limits const& limits) const;
+
+  size_t size() const { return count_; }
+
+  // Write a new index file, replacing `path` atomically. Returns the
+  // number of records written, as duplicate entries are only written once.
+  static size_t write(std::string const& path, std::vector<entry> entries);
+
+ private:
+  char const* records_{nullptr};
+  std::vector<hardware_limits> limits_;
+  void* data_{nullptr};
+  size_t mapped_{0};
+  size_t count_{0};
+};
+
+} // namespace gpsdo_config
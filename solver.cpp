@@ -22,46 +22,71 @@
 #include "solver.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
 #include <numeric>
 #include <optional>
-#include <unordered_set>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
 
-#define SOLVER_DEBUG_STDOUT 0
-
-#if SOLVER_DEBUG_STDOUT
-#include <iostream>
-#endif
-
-#include <boost/functional/hash.hpp>
-#include <boost/integer/common_factor.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
-namespace std {
-template <>
-struct hash<gpsdo_config::rat64> {
-  std::size_t operator()(gpsdo_config::rat64 const& r) const noexcept {
-    std::size_t seed = 0;
-    boost::hash_combine(seed, r.numerator());
-    boost::hash_combine(seed, r.denominator());
-    return seed;
-  }
-};
-} // namespace std
+#include "parallel.h"
 
 namespace gpsdo_config {
 
 namespace {
 
+__extension__ using int128_t = __int128;
+
+/**
+ * Compute floor(a * b / c), or ceil(a * b / c) if `round_up` is set, for
+ * non-negative a and b and positive c
+ *
+ * The product is only widened to 128 bits if it doesn't fit into 64 bits.
+ * Results that don't fit are saturated to INT64_MAX.
+ */
+int64_t mul_div(int64_t a, int64_t b, int64_t c, bool round_up = false) {
+  if (int64_t ab; !__builtin_mul_overflow(a, b, &ab)) {
+    return ab / c + (round_up and ab % c != 0);
+  }
+
+  auto const ab = static_cast<int128_t>(a) * b;
+  auto const q = ab / c + (round_up and ab % c != 0);
+
+  return static_cast<int64_t>(
+      std::min<int128_t>(q, std::numeric_limits<int64_t>::max()));
+}
+
 /**
  * Find the least common multiple of two rational numbers
+ *
+ * For irreducible fractions a / b and c / d, this is the irreducible
+ * fraction lcm(a, c) / gcd(b, d). Unlike going through a common
+ * denominator, this only overflows if the result doesn't fit into a rat64,
+ * and then returns nothing.
  */
-rat64 rat_lcm(rat64 r1, rat64 r2) {
-  int64_t den = boost::integer::lcm(r1.denominator(), r2.denominator());
-  int64_t num = boost::integer::lcm(
-      r1.numerator() * (den / r1.denominator()),
-      r2.numerator() * (den / r2.denominator()));
-  return rat64(num, den);
+std::optional<rat64> rat_lcm(rat64 r1, rat64 r2) {
+  auto const a = r1.numerator();
+  auto const c = r2.numerator();
+  int64_t num;
+
+  if (__builtin_mul_overflow(a / std::gcd(a, c), c, &num)) {
+    return std::nullopt;
+  }
+
+  return rat64(num, std::gcd(r1.denominator(), r2.denominator()));
 }
 
 #ifndef NDEBUG
@@ -77,37 +102,150 @@ bool is_in_ncx_ls_range(int64_t n) {
 }
 #endif
 
-std::vector<int32_t> factorize(int64_t n) {
-  std::vector<int32_t> factors;
+/**
+ * Open addressing hash set for values other than `empty`
+ *
+ * Unlike std::unordered_set, this doesn't allocate a node per value, and
+ * clear() keeps the table, so a set that is reused doesn't allocate at all
+ * once it has grown to its working size.
+ */
+template <typename T, typename Hash = std::hash<T>>
+class flat_set {
+ public:
+  flat_set(T const& empty, std::pmr::memory_resource* memory)
+      : empty_{empty}
+      , slots_{memory} {}
+
+  // Returns `true` if `value` wasn't in the set before
+  bool insert(T const& value) {
+    assert(value != empty_);
+
+    if (2 * (size_ + 1) > slots_.size()) {
+      rehash(std::max<size_t>(16, 2 * slots_.size()));
+    }
+
+    auto const mask = slots_.size() - 1;
+
+    for (auto i = slot(value);; i = (i + 1) & mask) {
+      if (slots_[i] == empty_) {
+        slots_[i] = value;
+        ++size_;
+        return true;
+      }
+
+      if (slots_[i] == value) {
+        return false;
+      }
+    }
+  }
+
+  void clear() {
+    std::fill(slots_.begin(), slots_.end(), empty_);
+    size_ = 0;
+  }
 
-  while (n % 2 == 0) {
-    factors.emplace_back(2);
-    n /= 2;
+ private:
+  // Fibonacci hashing, as std::hash is often the identity for integers
+  size_t slot(T const& value) const {
+    return (Hash{}(value) * UINT64_C(0x9e3779b97f4a7c15)) >> shift_;
   }
 
-  for (int i = 3; i <= std::sqrt(n); i += 2) {
-    while (n % i == 0) {
-      factors.emplace_back(i);
-      n /= i;
+  void rehash(size_t slots) {
+    std::pmr::vector<T> old(slots, empty_, slots_.get_allocator());
+    old.swap(slots_);
+    shift_ = 64 - std::countr_zero(slots);
+    size_ = 0;
+
+    for (auto const& v : old) {
+      if (v != empty_) {
+        insert(v);
+      }
     }
   }
 
-  if (n > 2) {
-    factors.emplace_back(n);
+  T const empty_;
+  size_t size_{0};
+  int shift_{0};
+  std::pmr::vector<T> slots_;
+};
+
+// Even a 64-bit number doesn't have more than 63 prime factors, so the
+// factor lists never need to allocate.
+using factor_list = boost::container::small_vector<int64_t, 64>;
+using factor_set = flat_set<int64_t>;
+
+/**
+ * All primes below 2**16, enough to fully factorize any 32-bit number
+ */
+std::vector<int32_t> const& small_primes() {
+  static std::vector<int32_t> const primes = [] {
+    int32_t constexpr LIMIT = 1 << 16;
+    std::vector<bool> composite(LIMIT);
+    std::vector<int32_t> p;
+
+    for (int32_t i = 2; i < LIMIT; ++i) {
+      if (!composite[i]) {
+        p.emplace_back(i);
+        for (int64_t j = int64_t{i} * i; j < LIMIT; j += i) {
+          composite[j] = true;
+        }
+      }
+    }
+
+    return p;
+  }();
+
+  return primes;
+}
+
+/**
+ * Append the prime factors of `n` in ascending order
+ */
+void factorize(int64_t n, factor_list& factors) {
+  auto const& primes = small_primes();
+  int64_t p = 2;
+
+  for (auto sp : primes) {
+    p = sp;
+
+    if (p * p > n) {
+      break;
+    }
+
+    while (n % p == 0) {
+      factors.emplace_back(p);
+      n /= p;
+    }
+  }
+
+  // Only reached for numbers with large prime factors.
+  for (p += 2; p * p <= n; p += 2) {
+    while (n % p == 0) {
+      factors.emplace_back(p);
+      n /= p;
+    }
   }
 
-  return factors;
+  if (n > 1) {
+    factors.emplace_back(n);
+  }
 }
 
 int64_t split_rec(
-    std::unordered_set<int64_t>& seen,
+    factor_set& seen,
     int64_t product,
     int64_t limit,
-    std::vector<int32_t> const& factors,
+    int64_t floor,
+    factor_list const& factors,
     unsigned index) {
   int64_t rv = 1;
 
-  if (seen.insert(product).second) {
+  // No factor of product can reach the floor, so don't bother.
+  if (product < floor) {
+    return rv;
+  }
+
+  if (seen.insert(product)) {
     while (index < factors.size()) {
       auto current = factors[index];
       auto res = product / current;
@@ -120,7 +258,7 @@ int64_t split_rec(
       }
 
       if (index + 1 < factors.size()) {
-        auto rr = split_rec(seen, res, limit, factors, index + 1);
+        auto rr = split_rec(seen, res, limit, floor, factors, index + 1);
 
         if (rr > rv) {
           rv = rr;
@@ -136,82 +274,351 @@ int64_t split_rec(
   return rv;
 }
 
-int64_t largest_factor(int64_t product, int64_t limit) {
-  std::unordered_set<int64_t> seen;
-  return split_rec(seen, product, limit, factorize(product), 0);
+/**
+ * Find the smallest factor of a number that is at least `lo`
+ *
+ * `factors` are the prime factors of the number in ascending order. This
+ * is a branch-and-bound search over the exponents of each prime, where the
+ * smallest factor found so far bounds the remaining search. Returns 0 if
+ * there is no such factor less than or equal to `hi`.
+ */
+int64_t
+smallest_factor_from(factor_list const& factors, int64_t lo, int64_t hi) {
+  int64_t best = hi + 1;
+
+  auto rec = [&](auto& self, size_t index, int64_t cur) -> void {
+    if (cur >= lo) {
+      // Multiplying by more factors only makes things worse.
+      best = std::min(best, cur);
+      return;
+    }
+
+    if (index >= factors.size()) {
+      return;
+    }
+
+    auto const p = factors[index];
+    auto next = index;
+
+    while (next < factors.size() and factors[next] == p) {
+      ++next;
+    }
+
+    for (auto i = index; i <= next; ++i) {
+      self(self, next, cur);
+
+      if (i == next or cur > (best - 1) / p) {
+        break;
+      }
+
+      cur *= p;
+    }
+  };
+
+  rec(rec, 0, 1);
+
+  return best <= hi ? best : 0;
 }
 
-} // namespace
+/**
+ * Factorization of the f3_N2 numerators visited during the search
+ *
+ * All numerators for a given fOSC = fLCM * n / d are of the form
+ * k * fLCM_num * n / g, where g is a divisor of 2 * N2_HS. Instead of
+ * factorizing each of them from scratch, we factorize fLCM_num at most
+ * once per search and n at most once per fOSC, and derive the rest by
+ * removing the factors of g and adding the factors of k. All scratch
+ * memory is kept between calls.
+ *
+ * fLCM_num can have large prime factors, and then its factorization takes
+ * longer than the rest of a typical search. It is only done once a factor
+ * search actually needs it.
+ *
+ * As product / x is the largest factor <= limit if x is the smallest
+ * factor >= product / limit, we search for the latter, which is usually
+ * small.
+ */
+class factor_cache {
+ public:
+  factor_cache(int64_t fLCM_num, std::pmr::memory_resource* memory)
+      : fLCM_num_{fLCM_num}
+      , seen_{0, memory} {}
 
-void solution::write(std::ostream& os, bool verbose) const {
-  os << "fGPS = " << fGPS << ", N31 = " << N31 << ", N1_HS = " << N1_HS
-     << ", NC1_LS = " << NC1_LS << ", NC2_LS = " << NC2_LS
-     << ", N2_HS = " << N2_HS << ", N2_LS = " << N2_LS;
+  void set_fosc(int64_t n) {
+    fosc_n_ = n;
+    fosc_valid_ = false;
+  }
 
-  if (verbose) {
-    auto f3 = rat64{fGPS, N31};
-    auto fOSC = f3 * N2_HS * N2_LS;
-    auto f1 = fOSC / (N1_HS * NC1_LS);
-    auto f2 = fOSC / (N1_HS * NC2_LS);
-    os << " [f3 = " << boost::rational_cast<double>(f3)
-       << ", fOSC = " << boost::rational_cast<double>(fOSC)
-       << ", f1 = " << boost::rational_cast<double>(f1)
-       << ", f2 = " << boost::rational_cast<double>(f2) << "]";
+  // Largest factor <= limit of product = k * fOSC_num / g, see above
+  int64_t largest_factor(
+      int64_t product, int64_t g, int64_t k, int64_t limit, int64_t floor) {
+    auto const lo = (product + limit - 1) / limit;
+    auto const hi = floor > 0 ? product / floor : product;
+
+    // Most of the time, x is only a little larger than lo, and it is faster
+    // to try a few divisions than to search the exponents of the factors.
+    auto const scan_hi = std::min(hi, lo + SCAN_WIDTH - 1);
+
+    for (auto x = lo; x <= scan_hi; ++x) {
+      if (product % x == 0) {
+        return product / x;
+      }
+    }
+
+    if (scan_hi >= hi) {
+      return 0;
+    }
+
+    if (!base_valid_) {
+      factorize(fLCM_num_, base_);
+      base_valid_ = true;
+    }
+
+    if (!fosc_valid_) {
+      tmp_.clear();
+      factorize(fosc_n_, tmp_);
+      fosc_.clear();
+      std::merge(
+          base_.begin(), base_.end(), tmp_.begin(), tmp_.end(),
+          std::back_inserter(fosc_));
+      fosc_valid_ = true;
+    }
+
+    work_ = fosc_;
+
+    tmp_.clear();
+    factorize(g, tmp_);
+
+    for (auto f : tmp_) {
+      work_.erase(std::lower_bound(work_.begin(), work_.end(), f));
+    }
+
+    tmp_.clear();
+    factorize(k, tmp_);
+
+    for (auto f : tmp_) {
+      work_.insert(std::upper_bound(work_.begin(), work_.end(), f), f);
+    }
+
+    auto const x = smallest_factor_from(work_, scan_hi + 1, hi);
+
+    return x > 0 ? product / x : 0;
   }
-}
 
-// This allows sorting solutions in order of decreasing PLL frequency f3.
-bool solution::operator<(solution const& rhs) const {
-  return static_cast<double>(fGPS) / N31
-         > static_cast<double>(rhs.fGPS) / rhs.N31;
+  /**
+   * Find the largest factor of `product` that is less than or equal to
+   * `limit`, without using any cached factors
+   *
+   * Factors below `floor` are of no interest to the caller; if there are no
+   * other factors, the result will be less than `floor`.
+   */
+  int64_t largest_factor(int64_t product, int64_t limit, int64_t floor) {
+    tmp_.clear();
+    factorize(product, tmp_);
+    seen_.clear();
+    return split_rec(seen_, product, limit, floor, tmp_, 0);
+  }
+
+ private:
+  // Covers the smallest factor of nearly all calls for typical inputs
+  static int64_t constexpr SCAN_WIDTH = 32;
+
+  int64_t const fLCM_num_;
+  bool base_valid_{false};
+  factor_list base_;
+  int64_t fosc_n_{0};
+  bool fosc_valid_{false};
+  factor_list fosc_;
+  factor_list work_;
+  factor_list tmp_;
+  factor_set seen_;
+};
+
+uint32_t constexpr N1_HS_MIN = 4;
+uint32_t constexpr N1_HS_MAX = 11;
+uint32_t constexpr N2_HS_MIN = 4;
+uint32_t constexpr N2_HS_MAX = 11;
+
+struct q_range {
+  int64_t lo;
+  int64_t hi;
+};
+
+class fosc_memo;
+
+/**
+ * Everything the search needs to know about a pair of frequencies
+ */
+struct search_space {
+  hardware_limits limits;
+  arith arithmetic;
+  int64_t N31_MAX;
+  rat64 fLCM;
+
+  // Set if fLCM's numerator is too large for any solution, in which case
+  // the search space is empty.
+  bool fLCM_too_large{false};
+
+  int64_t f1_div;
+  int64_t f2_div;
+  int64_t q_max;
+  std::array<q_range, N1_HS_MAX - N1_HS_MIN + 1> q_ranges;
+
+  // If set, PLL configurations are shared with other searches for the
+  // same f1 and limits.
+  fosc_memo* memo{nullptr};
+
+  // Where the search allocates its scratch memory
+  std::pmr::memory_resource* memory{std::pmr::get_default_resource()};
+
+  // If set, the search stops once this time has been reached and sets
+  // `*expired`, which is shared by all threads of the search.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  std::atomic<bool>* expired{nullptr};
+
+  // If set, find::{best,top_k,all} rank solutions by this model. The cost
+  // of a solution depends on fOSC, which is computed from f1.
+  cost_model const* cost{nullptr};
+  rat64 f1;
+
+  q_range const& q_bounds(uint32_t N1_HS) const {
+    return q_ranges[N1_HS - N1_HS_MIN];
+  }
+};
+
+/**
+ * Compute fLCM / f for a multiple fLCM of f
+ *
+ * As fLCM is a multiple of f, its numerator is a multiple of f's
+ * numerator and its denominator divides f's denominator, so this doesn't
+ * need a common denominator and can't overflow unless the result does.
+ */
+int64_t lcm_div(rat64 fLCM, rat64 f) {
+  return mul_div(
+      fLCM.numerator() / f.numerator(), f.denominator() / fLCM.denominator(),
+      1);
 }
 
-std::vector<solution> find_solutions(
-    rat64 f1, rat64 f2, hardware_limits const& limits, find algorithm) {
+search_space make_search_space(
+    std::span<output_spec const> outputs,
+    hardware_limits const& limits,
+    search_options const& options) {
   int64_t constexpr NCn_LS_MAX = 1 << 20;
-  int64_t constexpr N2_LS_MAX = 1 << 20;
   int64_t constexpr N3_MAX = 1 << 19;
-  int64_t const N31_MAX = std::min(N3_MAX, limits.GPS_HI / limits.F3_LO);
+
+  if (outputs.empty()) {
+    throw std::invalid_argument("no outputs");
+  }
+
+  check_limits(limits);
+
+  for (auto const& o : outputs) {
+    // Everything below divides by the frequencies
+    if (o.f <= 0) {
+      throw std::invalid_argument("frequencies must be positive");
+    }
+
+    if (o.NC_LS_max > NCn_LS_MAX) {
+      throw std::invalid_argument("output divider limit out of range");
+    }
+  }
+
+  if (auto const* c = options.cost) {
+    for (auto w : {c->f3, c->vco_margin, c->power, c->gps}) {
+      if (!std::isfinite(w) or w < 0) {
+        throw std::invalid_argument("cost model weights must be non-negative");
+      }
+    }
+  }
+
+  search_space sp;
+
+  sp.limits = limits;
+  sp.arithmetic = options.arithmetic;
+  sp.cost = options.cost;
+  sp.f1 = outputs.front().f;
+
+  if (options.memory and options.threads == 1) {
+    sp.memory = options.memory;
+  }
+
+  if (options.timeout > std::chrono::nanoseconds::zero()) {
+    sp.deadline = std::chrono::steady_clock::now() + options.timeout;
+  }
+  sp.N31_MAX = std::min(N3_MAX, limits.GPS_HI / limits.F3_LO);
+
+  // The largest numerator of an fOSC that can be part of a solution, as its
+  // denominator is at most N31_MAX. With the fOSC values that have larger
+  // denominators skipped, all numerators in the search fit into 64 bits.
+  auto const fOSC_num_max = std::min(
+      mul_div(limits.VCO_HI, sp.N31_MAX, 1),
+      std::numeric_limits<int64_t>::max() / 4);
 
   //
-  // We need to find a configuration for the Si53xx that can represent both
-  // frequencies f1 and f2. The frequencies generated are defined as follows:
+  // We need to find a configuration for the Si53xx that can represent all
+  // output frequencies fn. The frequencies generated are defined as follows:
   //
   //            fOSC             |  N1_HS  = [4, 5, ..., 11]
   //   fn = --------------       |  NCn_LS = [2, 4, 6, ..., 2**20]
   //        N1_HS * NCn_LS
   //
-  // So we first need to find the least common multiple of both frequencies.
+  // So we first need to find the least common multiple of all frequencies.
+  //
+  std::optional<rat64> fLCM = outputs.front().f;
+
+  for (auto const& o : outputs.subspan(1)) {
+    if (fLCM) {
+      fLCM = rat_lcm(*fLCM, o.f);
+    }
+  }
+
+  //
+  // The numerator of every fOSC = fLCM * m is a multiple of the numerator of
+  // fLCM, so if that is too large, there can't be any solutions.
   //
-  auto fLCM = rat_lcm(f1, f2);
+  if (!fLCM or fLCM->numerator() > fOSC_num_max) {
+    sp.fLCM_too_large = true;
+    sp.fLCM = 1;
+    sp.f1_div = sp.f2_div = 2;
+    sp.q_max = 0;
+    sp.q_ranges.fill({1, 0});
+    return sp;
+  }
+
+  sp.fLCM = *fLCM;
 
   //
   // As NCn_LS must be even, we check if the LCM divides any of the frequencies
   // into an odd number and double the LCM if necessary.
   //
-  if (boost::rational_cast<int64_t>(fLCM / f1) % 2 != 0
-      or boost::rational_cast<int64_t>(fLCM / f2) % 2 != 0) {
-    fLCM *= 2;
+  auto fn_div = [&](output_spec const& o) { return lcm_div(sp.fLCM, o.f); };
+
+  if (std::ranges::any_of(outputs, [&](auto const& o) {
+        return fn_div(o) % 2 != 0;
+      })) {
+    sp.fLCM *= 2;
   }
 
   //
-  // We can now compute the base divisors for both frequencies. NC1_LS and
-  // NC2_LS must be integer multiples of these divisors:
+  // We can now compute the base divisors for all frequencies. NCn_LS must
+  // be an integer multiple of these divisors:
   //
   //   NCn_LS = q * fn_div
   //
-  auto const f1_div = boost::rational_cast<int64_t>(fLCM / f1);
-  auto const f2_div = boost::rational_cast<int64_t>(fLCM / f2);
+  // The search only keeps track of the first two, the dividers of any other
+  // outputs follow from q.
+  //
+  sp.f1_div = fn_div(outputs.front());
+  sp.f2_div = fn_div(outputs[std::min<size_t>(1, outputs.size() - 1)]);
 
   // Compute the maximum possible value of q to limit our search space.
-  auto const q_max = NCn_LS_MAX / std::max(f1_div, f2_div);
-
-  std::unordered_set<rat64> fOSC_seen;
-  std::vector<solution> solutions;
+  sp.q_max = NCn_LS_MAX;
 
-  std::optional<find> found;
+  for (auto const& o : outputs) {
+    sp.q_max = std::min<int64_t>(sp.q_max, o.NC_LS_max / fn_div(o));
+  }
 
-  for (uint32_t N1_HS = 11; N1_HS >= 4; --N1_HS) {
+  for (uint32_t N1_HS = N1_HS_MAX; N1_HS >= N1_HS_MIN; --N1_HS) {
     //
     // We need a mulitple of fLCM at the output of the high speed divider N1_HS.
     // fN1 is just fLCM before division by N1_HS.
@@ -228,138 +635,1921 @@ std::vector<solution> find_solutions(
     //   fN1 = fLCM * N1_HS = ----
     //                         q
     //
-    auto const fN1 = N1_HS * fLCM;
+    auto const fN1_num = N1_HS * sp.fLCM.numerator();
+    auto const fN1_den = sp.fLCM.denominator();
 
     // From the limits of the VCO imposed on fOSC, we can dervice bounds for q.
-    auto const q_lo = static_cast<int64_t>(
-        std::ceil(boost::rational_cast<double>(limits.VCO_LO / fN1)));
-    auto const q_hi = std::min(
-        q_max, static_cast<int64_t>(std::floor(
-                   boost::rational_cast<double>(limits.VCO_HI / fN1))));
+    auto& [q_lo, q_hi] = sp.q_ranges[N1_HS - N1_HS_MIN];
+    q_lo = mul_div(limits.VCO_LO, fN1_den, fN1_num, true);
+    q_hi = std::min(sp.q_max, mul_div(limits.VCO_HI, fN1_den, fN1_num));
+  }
 
-    for (uint32_t q = q_lo; q <= q_hi; ++q) {
-      int64_t const NC1_LS = q * f1_div;
-      int64_t const NC2_LS = q * f2_div;
+  return sp;
+}
 
-      assert(is_in_ncx_ls_range(NC1_LS));
-      assert(is_in_ncx_ls_range(NC2_LS));
+search_space make_search_space(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    search_options const& options) {
+  output_spec const outputs[] = {{.f = f1}, {.f = f2}};
+  return make_search_space(outputs, limits, options);
+}
 
-      auto fOSC = fLCM * q * N1_HS;
+/**
+ * What the search should do after a solution has been visited
+ */
+enum class step {
+  next,      // keep going
+  last_fosc, // finish the current fOSC, but only with one solution per N2_HS
+  stop,      // stop immediately
+};
 
-#if SOLVER_DEBUG_STDOUT
-      std::cout << "N1_HS=" << N1_HS << ", fN1=" << fN1 << ", q_lo=" << q_lo
-                << ", q_hi=" << q_hi << ", q=" << q << ", NC1_LS=" << NC1_LS
-                << ", NC2_LS=" << NC2_LS << ", fOSC=" << fOSC << "\n";
-#endif
+/**
+ * A candidate for N2_HS along with the PLL frequency before the GPS
+ * reference divider, f3_N2 = fOSC / (2 * N2_HS), as an irreducible fraction
+ * and the divisor that turns fOSC's numerator into f3_N2's numerator
+ */
+struct N2_HS_candidate {
+  uint32_t N2_HS;
+  int64_t f3_N2_num;
+  int64_t f3_N2_den;
+  int64_t f3_N2_div;
+};
 
-      if (fOSC_seen.insert(fOSC).second) {
-        // Generate a list of candidates for N2_HS. We start by filling the list
-        // with all allowed value in reverse order (the reason being that larger
-        // values for the high-speed divider result in lower power consumption).
-        std::array<uint32_t, 8> N2_HS_candidates;
-        std::iota(N2_HS_candidates.rbegin(), N2_HS_candidates.rend(), 4);
-
-        // We now sort the list such that we minimize the denominators when
-        // dividing fOSC by the N2_HS candidate. This is in order to minimize
-        // N31, which allows us to keep f3 as high as possible.
-        std::stable_sort(
-            N2_HS_candidates.begin(), N2_HS_candidates.end(),
-            [&fOSC](uint32_t a, uint32_t b) {
-              return (fOSC / a).denominator() < (fOSC / b).denominator();
-            });
-
-        for (auto N2_HS : N2_HS_candidates) {
-          auto const f3_N2 = fOSC / (2 * N2_HS);
-
-          if (f3_N2.denominator() > N31_MAX) {
-            continue;
-          }
+using N2_HS_candidates
+    = std::array<N2_HS_candidate, N2_HS_MAX - N2_HS_MIN + 1>;
 
-          auto const k_hi = std::max(
-              INT64_C(1), limits.GPS_HI / (f3_N2.denominator() * limits.F3_HI));
-
-          for (int k = 1; k <= k_hi; ++k) {
-            // Compute the upper limit for the GPS frequency.
-            auto const N31_cand = k * f3_N2.denominator();
-            auto const f3_N2_num = k * f3_N2.numerator();
-            auto const gps_hi
-                = std::min<int64_t>(limits.GPS_HI, N31_cand * limits.F3_HI);
-            int64_t N2_LS_cand = 2;
-            int64_t fGPS;
-
-            if (f3_N2_num <= gps_hi) {
-              fGPS = f3_N2_num;
-            } else {
-              // Find the largest factor in f3_N2's numerator that is less than
-              // or equal to gps_hi.
-              fGPS = largest_factor(f3_N2_num, gps_hi);
-              N2_LS_cand *= f3_N2_num / fGPS;
-            }
-
-#if SOLVER_DEBUG_STDOUT
-            std::cout << "  N2_HS=" << N2_HS << ", N31_cand=" << N31_cand
-                      << ", gps_hi=" << gps_hi << ", f3_N2=" << f3_N2
-                      << ", k=" << k << ", fGPS=" << fGPS
-                      << ", N2_LS_cand=" << N2_LS_cand << "\n";
-#endif
+/**
+ * Order the N2_HS candidates in which they are tried for a given fOSC
+ *
+ * We start by filling the list with all allowed value in reverse order (the
+ * reason being that larger values for the high-speed divider result in lower
+ * power consumption). We then sort the list such that we minimize the
+ * denominators when dividing fOSC by the N2_HS candidate. This is in order
+ * to minimize N31, which allows us to keep f3 as high as possible.
+ */
+template <typename Key>
+void sort_N2_HS_candidates(N2_HS_candidates& cand, Key const& key) {
+  std::array<int64_t, std::tuple_size_v<N2_HS_candidates>> keys;
 
-            if (N2_LS_cand > N2_LS_MAX
-                or static_cast<double>(fGPS) / N31_cand < limits.F3_LO) {
-              continue;
-            }
-
-            // We have found a new possible solution.
-            solution sol{
-                .fGPS = boost::numeric_cast<uint32_t>(fGPS),
-                .N31 = boost::numeric_cast<uint32_t>(N31_cand),
-                .N1_HS = N1_HS,
-                .NC1_LS = boost::numeric_cast<uint32_t>(NC1_LS),
-                .NC2_LS = boost::numeric_cast<uint32_t>(NC2_LS),
-                .N2_HS = N2_HS,
-                .N2_LS = boost::numeric_cast<uint32_t>(N2_LS_cand),
-            };
-
-            if (found and algorithm != find::all) {
-              if (sol < solutions[0]) {
-                solutions[0] = sol;
-              }
-            } else {
-              solutions.emplace_back(sol);
-            }
-
-            if (algorithm != find::all) {
-              auto f3r = N31_cand * limits.F3_HI;
-              auto fnd = f3r == fGPS       ? find::best
-                         : f3r <= fGPS * 2 ? find::good
-                                           : find::any;
-
-              if (!found or fnd > *found) {
-                found = fnd;
-              }
-
-              if (*found >= algorithm) {
-                break;
-              }
-            }
-          }
-        }
-      }
+  for (size_t i = 0; i < cand.size(); ++i) {
+    cand[i].N2_HS = N2_HS_MAX - i;
+    keys[i] = key(cand[i].N2_HS);
+  }
 
-      if (found and (*found >= algorithm)) {
-        break;
-      }
+  std::array<uint8_t, std::tuple_size_v<N2_HS_candidates>> order;
+  std::iota(order.begin(), order.end(), 0);
+
+  // A stable insertion sort, std::stable_sort() allocates a buffer.
+  for (size_t i = 1; i < order.size(); ++i) {
+    for (auto j = i; j > 0 and keys[order[j]] < keys[order[j - 1]]; --j) {
+      std::swap(order[j], order[j - 1]);
     }
+  }
 
-    if (found and (*found >= algorithm)) {
-      break;
+  N2_HS_candidates sorted;
+
+  for (size_t i = 0; i < cand.size(); ++i) {
+    sorted[i] = cand[order[i]];
+  }
+
+  cand = sorted;
+}
+
+/**
+ * Reference implementation of the N2_HS candidates based on rat64
+ */
+N2_HS_candidates make_N2_HS_candidates(rat64 const& fOSC) {
+  N2_HS_candidates cand;
+
+  sort_N2_HS_candidates(
+      cand, [&fOSC](uint32_t N2_HS) { return (fOSC / N2_HS).denominator(); });
+
+  for (auto& c : cand) {
+    auto const f3_N2 = fOSC / (2 * c.N2_HS);
+    c.f3_N2_num = f3_N2.numerator();
+    c.f3_N2_den = f3_N2.denominator();
+    c.f3_N2_div = fOSC.numerator() / f3_N2.numerator();
+  }
+
+  return cand;
+}
+
+/**
+ * Integer implementation of the N2_HS candidates for fOSC = num / den
+ *
+ * As num / den is irreducible, gcd(num, den * n) = gcd(num, n), and with
+ * g = gcd(num, n), gcd(num, 2 * n) is either g or 2 * g, depending on
+ * whether num / g is even. So we only need a single gcd per N2_HS.
+ */
+N2_HS_candidates make_N2_HS_candidates(int64_t num, int64_t den) {
+  N2_HS_candidates cand;
+  std::array<int64_t, N2_HS_MAX + 1> gcds;
+
+  for (uint32_t n = N2_HS_MIN; n <= N2_HS_MAX; ++n) {
+    gcds[n] = std::gcd(num, int64_t{n});
+  }
+
+  sort_N2_HS_candidates(cand, [&](uint32_t N2_HS) {
+    return den * (N2_HS / gcds[N2_HS]);
+  });
+
+  for (auto& c : cand) {
+    auto g = gcds[c.N2_HS];
+
+    if ((num / g) % 2 == 0) {
+      g *= 2;
     }
+
+    c.f3_N2_num = num / g;
+    c.f3_N2_den = den * ((2 * c.N2_HS) / g);
+    c.f3_N2_div = g;
   }
 
-  if (solutions.size() > 1) {
-    std::stable_sort(solutions.begin(), solutions.end());
+  return cand;
+}
+
+N2_HS_candidates make_N2_HS_candidates(
+    search_space const& sp, uint32_t N1_HS, int64_t q, factor_cache& fc) {
+  if (sp.arithmetic == arith::rational) {
+    return make_N2_HS_candidates(sp.fLCM * q * N1_HS);
   }
 
-  return solutions;
+  // fOSC = fLCM * m, with fLCM irreducible
+  auto const m = q * N1_HS;
+  auto const g = std::gcd(m, sp.fLCM.denominator());
+
+  fc.set_fosc(m / g);
+
+  return make_N2_HS_candidates(
+      sp.fLCM.numerator() * (m / g), sp.fLCM.denominator() / g);
+}
+
+/**
+ * What is known about a solution before its fGPS has been searched, which
+ * is everything that visitors need to compute a bound for fGPS
+ */
+struct candidate {
+  uint32_t N1_HS;
+  uint32_t NC1_LS;
+  uint32_t N2_HS;
+  int64_t N31;
+};
+
+/**
+ * Wrap a visitor so the search loops collect solver_stats
+ *
+ * The loops find the counters through counters_of(), which returns
+ * `nullptr` for any other visitor, so the counting code is optimized out
+ * unless it is actually used.
+ */
+template <typename Visitor>
+class counting_visitor {
+ public:
+  counting_visitor(Visitor& visit, solver_stats& stats)
+      : visit_{visit}
+      , stats_{stats} {}
+
+  step operator()(solution const& sol) { return visit_(sol); }
+
+  int64_t min_fGPS(candidate const& c) const
+    requires requires(Visitor const& v) { v.min_fGPS(c); }
+  {
+    return visit_.min_fGPS(c);
+  }
+
+  solver_stats::counters& counters(uint32_t N1_HS) {
+    return stats_.by_N1_HS[N1_HS];
+  }
+
+ private:
+  Visitor& visit_;
+  solver_stats& stats_;
+};
+
+template <typename Visitor>
+solver_stats::counters* counters_of(Visitor& visit, uint32_t N1_HS) {
+  if constexpr (requires { visit.counters(N1_HS); }) {
+    return &visit.counters(N1_HS);
+  } else {
+    return nullptr;
+  }
+}
+
+/**
+ * Call `fn(visit)`, or `fn` with a counting wrapper around `visit` if
+ * `stats` is not null
+ */
+template <typename Visitor, typename Fn>
+auto with_stats(solver_stats* stats, Visitor& visit, Fn const& fn) {
+  if (stats) {
+    counting_visitor<Visitor> cv(visit, *stats);
+    return fn(cv);
+  }
+  return fn(visit);
+}
+
+/**
+ * Search all solutions for a single VCO frequency fOSC = fLCM * q * N1_HS
+ *
+ * Returns `false` if the visitor asked to stop the search.
+ */
+template <typename Visitor>
+bool search_fosc(
+    search_space const& sp,
+    uint32_t N1_HS,
+    int64_t q,
+    factor_cache& fc,
+    Visitor& visit) {
+  int64_t constexpr N2_LS_MAX = 1 << 20;
+
+  auto const& limits = sp.limits;
+  auto* const cnt = counters_of(visit, N1_HS);
+  int64_t const NC1_LS = q * sp.f1_div;
+  int64_t const NC2_LS = q * sp.f2_div;
+  bool last = false;
+
+  // The denominator of every f3_N2 is a multiple of fOSC's. Skipping
+  // fOSC values with too large a denominator also ensures that their
+  // numerators, which could overflow, are never computed.
+  auto const m = q * N1_HS;
+  auto const den = sp.fLCM.denominator();
+
+  if (den / std::gcd(m, den) > sp.N31_MAX) {
+    if (cnt) {
+      cnt->rejected_N31_range += std::tuple_size_v<N2_HS_candidates>;
+    }
+    return true;
+  }
+
+  for (auto const& c : make_N2_HS_candidates(sp, N1_HS, q, fc)) {
+    auto const N2_HS = c.N2_HS;
+
+    if (c.f3_N2_den > sp.N31_MAX) {
+      if (cnt) {
+        ++cnt->rejected_N31_range;
+      }
+      continue;
+    }
+
+    auto const k_hi
+        = std::max(INT64_C(1), limits.GPS_HI / (c.f3_N2_den * limits.F3_HI));
+
+    for (int k = 1; k <= k_hi; ++k) {
+      // Compute the upper limit for the GPS frequency.
+      auto const N31_cand = k * c.f3_N2_den;
+      auto const f3_N2_num = k * c.f3_N2_num;
+      auto const gps_hi
+          = std::min<int64_t>(limits.GPS_HI, N31_cand * limits.F3_HI);
+      int64_t N2_LS_cand = 2;
+      int64_t fGPS;
+      int64_t fGPS_min = 0;
+
+      if (cnt) {
+        ++cnt->N31_candidates;
+      }
+
+      if constexpr (requires { visit.min_fGPS(candidate{}); }) {
+        // The visitor is only interested in solutions with a high enough
+        // fGPS, and we know that fGPS can be at most min(gps_hi, f3_N2_num).
+        fGPS_min = visit.min_fGPS({
+            .N1_HS = N1_HS,
+            .NC1_LS = static_cast<uint32_t>(NC1_LS),
+            .N2_HS = N2_HS,
+            .N31 = N31_cand,
+        });
+
+        if (std::min(gps_hi, f3_N2_num) < fGPS_min) {
+          if (cnt) {
+            ++cnt->rejected_bound;
+          }
+          continue;
+        }
+      }
+
+      if (f3_N2_num <= gps_hi) {
+        fGPS = f3_N2_num;
+      } else {
+        // Find the largest factor in f3_N2's numerator that is less than
+        // or equal to gps_hi.
+        std::chrono::steady_clock::time_point start;
+
+        if (cnt) {
+          ++cnt->factor_calls;
+          start = std::chrono::steady_clock::now();
+        }
+
+        fGPS = sp.arithmetic == arith::rational
+                   ? fc.largest_factor(f3_N2_num, gps_hi, fGPS_min)
+                   : fc.largest_factor(
+                         f3_N2_num, c.f3_N2_div, k, gps_hi, fGPS_min);
+
+        if (cnt) {
+          cnt->factor_time += std::chrono::steady_clock::now() - start;
+        }
+
+        if (fGPS < fGPS_min) {
+          if (cnt) {
+            ++cnt->rejected_no_factor;
+          }
+          continue;
+        }
+
+        N2_LS_cand *= f3_N2_num / fGPS;
+      }
+
+      if (N2_LS_cand > N2_LS_MAX) {
+        if (cnt) {
+          ++cnt->rejected_N2_LS_range;
+        }
+        continue;
+      }
+
+      if (static_cast<double>(fGPS) / N31_cand < limits.F3_LO) {
+        if (cnt) {
+          ++cnt->rejected_F3_range;
+        }
+        continue;
+      }
+
+      // We have found a new possible solution.
+      solution sol{
+          .fGPS = boost::numeric_cast<uint32_t>(fGPS),
+          .N31 = boost::numeric_cast<uint32_t>(N31_cand),
+          .N1_HS = N1_HS,
+          .NC1_LS = boost::numeric_cast<uint32_t>(NC1_LS),
+          .NC2_LS = boost::numeric_cast<uint32_t>(NC2_LS),
+          .N2_HS = N2_HS,
+          .N2_LS = boost::numeric_cast<uint32_t>(N2_LS_cand),
+      };
+
+      if (cnt) {
+        ++cnt->solutions;
+      }
+
+      auto const s = visit(sol);
+
+      if (s == step::stop) {
+        return false;
+      }
+
+      if (s == step::last_fosc) {
+        last = true;
+        break;
+      }
+    }
+  }
+
+  return !last;
+}
+
+/**
+ * The part of a solution that only depends on fOSC and the limits
+ */
+struct pll_config {
+  uint32_t fGPS;
+  uint32_t N31;
+  uint32_t N2_HS;
+  uint32_t N2_LS;
+};
+
+/**
+ * PLL configurations for each fOSC = f1 * n, in search order
+ *
+ * Entries are never modified or removed once inserted, so references to
+ * them stay valid while other threads add entries.
+ */
+class fosc_memo {
+ public:
+  using configs = std::vector<pll_config>;
+
+  configs const* find(int64_t n) const {
+    std::lock_guard lock(mx_);
+    auto it = memo_.find(n);
+    return it == memo_.end() ? nullptr : &it->second;
+  }
+
+  configs const& insert(int64_t n, configs&& c) {
+    std::lock_guard lock(mx_);
+    return memo_.try_emplace(n, std::move(c)).first->second;
+  }
+
+  size_t size() const {
+    std::lock_guard lock(mx_);
+    return memo_.size();
+  }
+
+ private:
+  std::unordered_map<int64_t, configs> memo_;
+  mutable std::mutex mx_;
+};
+
+/**
+ * Check if the search has reached its deadline
+ *
+ * Reading the clock isn't free, so it's only read on every 64th call with
+ * the same `calls` counter. The deadline is only checked between fOSC
+ * values, so the solutions recorded for an fOSC are always complete.
+ */
+bool past_deadline(search_space const& sp, uint32_t& calls) {
+  if (!sp.deadline) {
+    return false;
+  }
+
+  if (sp.expired->load(std::memory_order_relaxed)) {
+    return true;
+  }
+
+  if (calls++ % 64 != 0 or std::chrono::steady_clock::now() < *sp.deadline) {
+    return false;
+  }
+
+  sp.expired->store(true, std::memory_order_relaxed);
+
+  return true;
+}
+
+/**
+ * Visit all solutions for a single VCO frequency fOSC = fLCM * q * N1_HS
+ *
+ * With a memo, the PLL configurations for fOSC are only searched once
+ * and then replayed to the visitor, with the same pruning and the same
+ * handling of step::last_fosc as in search_fosc().
+ *
+ * Returns `false` if the visitor asked to stop the search.
+ */
+template <typename Visitor>
+bool visit_fosc(
+    search_space const& sp,
+    uint32_t N1_HS,
+    int64_t q,
+    factor_cache& fc,
+    Visitor& visit) {
+  if (!sp.memo) {
+    return search_fosc(sp, N1_HS, q, fc, visit);
+  }
+
+  auto const n = q * N1_HS * sp.f1_div;
+  auto* const cnt = counters_of(visit, N1_HS);
+  auto const* configs = sp.memo->find(n);
+
+  if (configs) {
+    if (cnt) {
+      ++cnt->fosc_memo_hits;
+    }
+  } else {
+    fosc_memo::configs c;
+
+    auto record = [&](solution const& sol) {
+      c.push_back({sol.fGPS, sol.N31, sol.N2_HS, sol.N2_LS});
+      return step::next;
+    };
+
+    if (cnt) {
+      struct counting_record {
+        decltype(record)& rec;
+        solver_stats::counters& cnt;
+
+        step operator()(solution const& sol) { return rec(sol); }
+        solver_stats::counters& counters(uint32_t) { return cnt; }
+      } cr{record, *cnt};
+
+      search_fosc(sp, N1_HS, q, fc, cr);
+
+      // Only solutions actually passed to the visitor below are counted.
+      cnt->solutions -= c.size();
+    } else {
+      search_fosc(sp, N1_HS, q, fc, record);
+    }
+
+    configs = &sp.memo->insert(n, std::move(c));
+  }
+
+  auto const NC1_LS = boost::numeric_cast<uint32_t>(q * sp.f1_div);
+  auto const NC2_LS = boost::numeric_cast<uint32_t>(q * sp.f2_div);
+  uint32_t skip_N2_HS = 0;
+  bool last = false;
+
+  for (auto const& pc : *configs) {
+    if (pc.N2_HS == skip_N2_HS) {
+      continue;
+    }
+
+    if constexpr (requires { visit.min_fGPS(candidate{}); }) {
+      if (pc.fGPS < visit.min_fGPS({
+              .N1_HS = N1_HS,
+              .NC1_LS = NC1_LS,
+              .N2_HS = pc.N2_HS,
+              .N31 = pc.N31,
+          })) {
+        continue;
+      }
+    }
+
+    if (cnt) {
+      ++cnt->solutions;
+    }
+
+    auto const s = visit(solution{
+        .fGPS = pc.fGPS,
+        .N31 = pc.N31,
+        .N1_HS = N1_HS,
+        .NC1_LS = NC1_LS,
+        .NC2_LS = NC2_LS,
+        .N2_HS = pc.N2_HS,
+        .N2_LS = pc.N2_LS,
+    });
+
+    if (s == step::stop) {
+      return false;
+    }
+
+    if (s == step::last_fosc) {
+      last = true;
+      skip_N2_HS = pc.N2_HS;
+    }
+  }
+
+  return !last;
+}
+
+/**
+ * Set of the fOSC values visited by search()
+ *
+ * Each fOSC = fLCM * q * N1_HS is identified by the integer m = q * N1_HS,
+ * and all of them lie in a narrow range given by the VCO limits, so they
+ * can be kept in a bitmap over that range.
+ */
+class fosc_bitmap {
+ public:
+  explicit fosc_bitmap(search_space const& sp)
+      : words_{sp.memory} {
+    auto m_hi = std::numeric_limits<int64_t>::min();
+
+    for (uint32_t N1_HS = N1_HS_MIN; N1_HS <= N1_HS_MAX; ++N1_HS) {
+      auto const [q_lo, q_hi] = sp.q_bounds(N1_HS);
+
+      if (q_lo <= q_hi) {
+        m_lo_ = std::min(m_lo_, q_lo * N1_HS);
+        m_hi = std::max(m_hi, q_hi * N1_HS);
+      }
+    }
+
+    if (m_lo_ <= m_hi) {
+      words_.resize((m_hi - m_lo_) / 64 + 1);
+    }
+  }
+
+  // Returns `true` if `m` wasn't in the set before
+  bool insert(int64_t m) {
+    auto const i = static_cast<uint64_t>(m - m_lo_);
+    auto& word = words_[i / 64];
+    auto const bit = uint64_t{1} << (i % 64);
+
+    if (word & bit) {
+      return false;
+    }
+
+    word |= bit;
+
+    return true;
+  }
+
+ private:
+  int64_t m_lo_{std::numeric_limits<int64_t>::max()};
+  std::pmr::vector<uint64_t> words_;
+};
+
+/**
+ * Visit all solutions in search order
+ *
+ * Returns `false` if the search was stopped by the visitor or deadline.
+ */
+template <typename Visitor>
+bool search(search_space const& sp, Visitor&& visit) {
+  fosc_bitmap fOSC_seen(sp);
+  factor_cache fc(sp.fLCM.numerator(), sp.memory);
+  uint32_t calls = 0;
+
+  for (uint32_t N1_HS = N1_HS_MAX; N1_HS >= N1_HS_MIN; --N1_HS) {
+    auto const [q_lo, q_hi] = sp.q_bounds(N1_HS);
+    auto* const cnt = counters_of(visit, N1_HS);
+
+    for (int64_t q = q_lo; q <= q_hi; ++q) {
+      assert(is_in_ncx_ls_range(q * sp.f1_div));
+      assert(is_in_ncx_ls_range(q * sp.f2_div));
+
+      if (cnt) {
+        ++cnt->q_values;
+      }
+
+      if (fOSC_seen.insert(q * N1_HS)) {
+        if (past_deadline(sp, calls)
+            or !visit_fosc(sp, N1_HS, q, fc, visit)) {
+          return false;
+        }
+      } else if (cnt) {
+        ++cnt->fosc_duplicates;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Check if (N1_HS, q) is the first combination in search order that
+ * produces its fOSC
+ *
+ * As fOSC = fLCM * q * N1_HS, the same fOSC has been produced before if
+ * any larger N1_HS divides q * N1_HS with a quotient inside its q range.
+ * Unlike a set of seen frequencies, this doesn't depend on the order in
+ * which the search space is traversed.
+ */
+bool is_first_fosc(search_space const& sp, uint32_t N1_HS, int64_t q) {
+  auto const m = q * N1_HS;
+
+  for (uint32_t n = N1_HS + 1; n <= N1_HS_MAX; ++n) {
+    if (m % n == 0) {
+      auto const [q_lo, q_hi] = sp.q_bounds(n);
+      auto const qn = m / n;
+
+      if (q_lo <= qn and qn <= q_hi) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Check if the search space can contain any solutions
+ *
+ * Every solution has an fOSC = fLCM * m, with m = q * N1_HS for a q in the
+ * range of N1_HS. The denominator of f3_N2 = fOSC / (2 * N2_HS) must not
+ * exceed N31_MAX and is a multiple of the denominator of fOSC, which is
+ * den(fLCM) / gcd(den(fLCM), m). That can only be k if den(fLCM) / k
+ * divides m, so we try all k <= N31_MAX that divide den(fLCM).
+ */
+infeasibility check_feasibility(search_space const& sp) {
+  if (sp.fLCM_too_large) {
+    return infeasibility::N31_range;
+  }
+
+  bool in_vco_range = false;
+
+  for (uint32_t N1_HS = N1_HS_MIN; N1_HS <= N1_HS_MAX; ++N1_HS) {
+    auto const [q_lo, q_hi] = sp.q_bounds(N1_HS);
+    in_vco_range = in_vco_range or q_lo <= q_hi;
+  }
+
+  if (!in_vco_range) {
+    return infeasibility::VCO_range;
+  }
+
+  auto const den = sp.fLCM.denominator();
+
+  // Larger k are more likely to work, and k = den always does.
+  for (auto k = std::min(sp.N31_MAX, den); k > 0; --k) {
+    if (den % k != 0) {
+      continue;
+    }
+
+    auto const g = den / k;
+
+    for (uint32_t N1_HS = N1_HS_MIN; N1_HS <= N1_HS_MAX; ++N1_HS) {
+      auto const [q_lo, q_hi] = sp.q_bounds(N1_HS);
+      auto const step = g / std::gcd(g, int64_t{N1_HS});
+
+      if (q_lo <= q_hi and q_hi / step * step >= q_lo) {
+        return infeasibility::none;
+      }
+    }
+  }
+
+  return infeasibility::N31_range;
+}
+
+/**
+ * A contiguous range of q values for a single N1_HS
+ */
+struct work_chunk {
+  uint32_t N1_HS;
+  int64_t q_begin;
+  int64_t q_end;
+};
+
+/**
+ * Split the search space into chunks, in search order
+ */
+std::vector<work_chunk> make_chunks(search_space const& sp) {
+  int64_t constexpr CHUNK_SIZE = 256;
+  std::vector<work_chunk> chunks;
+
+  for (uint32_t N1_HS = N1_HS_MAX; N1_HS >= N1_HS_MIN; --N1_HS) {
+    auto const [q_lo, q_hi] = sp.q_bounds(N1_HS);
+
+    for (int64_t q = q_lo; q <= q_hi; q += CHUNK_SIZE) {
+      chunks.push_back({N1_HS, q, std::min(q + CHUNK_SIZE, q_hi + 1)});
+    }
+  }
+
+  return chunks;
+}
+
+/**
+ * Visit all solutions of a chunk in search order
+ *
+ * Returns `false` if the search was stopped by the visitor or deadline.
+ */
+template <typename Visitor>
+bool visit_chunk(search_space const& sp, work_chunk const& c, Visitor&& visit) {
+  factor_cache fc(sp.fLCM.numerator(), sp.memory);
+  auto* const cnt = counters_of(visit, c.N1_HS);
+  uint32_t calls = 0;
+
+  for (int64_t q = c.q_begin; q < c.q_end; ++q) {
+    if (cnt) {
+      ++cnt->q_values;
+    }
+
+    if (is_first_fosc(sp, c.N1_HS, q)) {
+      if (past_deadline(sp, calls)
+          or !visit_fosc(sp, c.N1_HS, q, fc, visit)) {
+        return false;
+      }
+    } else if (cnt) {
+      ++cnt->fosc_duplicates;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Classify a solution according to its PLL frequency f3
+ */
+find solution_quality(solution const& sol, hardware_limits const& limits) {
+  int64_t const fGPS = sol.fGPS;
+  auto const f3r = sol.N31 * limits.F3_HI;
+  return f3r == fGPS       ? find::best
+         : f3r <= fGPS * 2 ? find::good
+                           : find::any;
+}
+
+/**
+ * Compare PLL frequencies f3 = fGPS / N31 exactly like solution::operator<
+ */
+double f3_key(int64_t fGPS, int64_t N31) {
+  return static_cast<double>(fGPS) / N31;
+}
+
+candidate candidate_of(solution const& sol) {
+  return {
+      .N1_HS = sol.N1_HS,
+      .NC1_LS = sol.NC1_LS,
+      .N2_HS = sol.N2_HS,
+      .N31 = sol.N31,
+  };
+}
+
+double cost_of(
+    cost_model const& model,
+    hardware_limits const& limits,
+    double f1,
+    candidate const& c,
+    int64_t fGPS) {
+  auto const fOSC = f1 * (c.N1_HS * c.NC1_LS);
+  auto const margin
+      = std::min(fOSC - limits.VCO_LO, limits.VCO_HI - fOSC)
+        / ((limits.VCO_HI - limits.VCO_LO) / 2.0);
+  auto const power
+      = static_cast<double>((N1_HS_MAX - c.N1_HS) + (N2_HS_MAX - c.N2_HS))
+        / ((N1_HS_MAX - N1_HS_MIN) + (N2_HS_MAX - N2_HS_MIN));
+
+  return model.f3 * (1 - f3_key(fGPS, c.N31) / limits.F3_HI)
+         + model.vco_margin * (1 - std::clamp(margin, 0.0, 1.0))
+         + model.power * power
+         + model.gps * (1 - static_cast<double>(fGPS) / limits.GPS_HI);
+}
+
+/**
+ * Rank solutions by f3, like solution::operator<
+ *
+ * A rank assigns a key to each solution, and solutions with higher keys
+ * rank first. The key of a candidate must not decrease with its fGPS, and
+ * estimate() should return an fGPS close to the smallest one whose key
+ * reaches a given key.
+ */
+struct f3_rank {
+  int64_t GPS_HI;
+
+  double key(candidate const& c, int64_t fGPS) const {
+    return f3_key(fGPS, c.N31);
+  }
+
+  int64_t estimate(candidate const& c, double key) const {
+    return static_cast<int64_t>(key * c.N31);
+  }
+
+  int64_t fGPS_limit() const { return GPS_HI + 1; }
+};
+
+/**
+ * Rank solutions by their cost, using the negated cost as the key
+ */
+class cost_rank {
+ public:
+  cost_rank(cost_model const& model, hardware_limits const& limits, rat64 f1)
+      : model_{model}
+      , limits_{limits}
+      , f1_{boost::rational_cast<double>(f1)} {}
+
+  double key(candidate const& c, int64_t fGPS) const {
+    return -cost_of(model_, limits_, f1_, c, fGPS);
+  }
+
+  // The cost decreases linearly with fGPS.
+  int64_t estimate(candidate const& c, double key) const {
+    auto const slope = model_.f3 / (static_cast<double>(c.N31) * limits_.F3_HI)
+                       + model_.gps / limits_.GPS_HI;
+    auto const key0 = this->key(c, 0);
+
+    if (slope == 0) {
+      return key0 >= key ? 0 : fGPS_limit();
+    }
+
+    return static_cast<int64_t>(std::clamp(
+        (key - key0) / slope, 0.0, static_cast<double>(fGPS_limit())));
+  }
+
+  int64_t fGPS_limit() const { return limits_.GPS_HI + 1; }
+
+ private:
+  cost_model const model_;
+  hardware_limits const limits_;
+  double const f1_;
+};
+
+/**
+ * Call `fn` with the rank of the solutions for `sp`
+ */
+template <typename Fn>
+auto with_rank(search_space const& sp, Fn const& fn) {
+  if (sp.cost) {
+    return fn(cost_rank(*sp.cost, sp.limits, sp.f1));
+  }
+  return fn(f3_rank{sp.limits.GPS_HI});
+}
+
+/**
+ * Key of the best solution found so far by any thread
+ */
+using shared_best = std::atomic<double>;
+
+double constexpr no_key = -std::numeric_limits<double>::infinity();
+
+std::optional<double> load(shared_best const* shared) {
+  if (shared) {
+    if (auto v = shared->load(std::memory_order_relaxed); v != no_key) {
+      return v;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * Raise `shared` to `key` unless it already is at least as high
+ */
+void publish(shared_best& shared, double key) {
+  auto cur = shared.load(std::memory_order_relaxed);
+
+  while (key > cur and !shared.compare_exchange_weak(cur, key)) {
+  }
+}
+
+/**
+ * The smallest fGPS for a candidate whose key is strictly higher than `gt`
+ * and at least as high as `ge`, or the rank's fGPS_limit() if there is
+ * no such fGPS
+ */
+template <typename Rank>
+int64_t fGPS_threshold(
+    Rank const& rank,
+    candidate const& c,
+    std::optional<double> gt,
+    std::optional<double> ge) {
+  if (!gt and !ge) {
+    return 0;
+  }
+
+  auto const limit = rank.fGPS_limit();
+
+  auto accept = [&](int64_t fGPS) {
+    if (fGPS >= limit) {
+      return true;
+    }
+    auto const key = rank.key(c, fGPS);
+    return (!gt or key > *gt) and (!ge or key >= *ge);
+  };
+
+  // The estimate is usually off by at most one due to rounding, so we
+  // search outwards from it with growing steps and then bisect the last
+  // step. As keys never decrease with fGPS, the result is exact.
+  auto const bound = std::max(gt.value_or(no_key), ge.value_or(no_key));
+  auto const fGPS = std::clamp<int64_t>(rank.estimate(c, bound), 0, limit);
+  int64_t lo = -1;
+  int64_t hi = limit;
+
+  if (accept(fGPS)) {
+    hi = fGPS;
+    for (int64_t step = 1; hi - step >= 0; step *= 2) {
+      if (!accept(hi - step)) {
+        lo = hi - step;
+        break;
+      }
+      hi -= step;
+    }
+  } else {
+    lo = fGPS;
+    for (int64_t step = 1;; step *= 2) {
+      auto const next = std::min(lo + step, limit);
+      if (accept(next)) {
+        hi = next;
+        break;
+      }
+      lo = next;
+    }
+  }
+
+  while (hi - lo > 1) {
+    auto const mid = lo + (hi - lo) / 2;
+    (accept(mid) ? hi : lo) = mid;
+  }
+
+  return hi;
+}
+
+/**
+ * Keep track of the best solution for find::{any,good,best}
+ *
+ * The search can stop after the fOSC for which a solution of at least
+ * the requested quality has been found.
+ *
+ * For find::best, the best solution found so far is used to prune the
+ * search: a solution only replaces the current one if its f3 is strictly
+ * higher, so candidates that cannot beat it don't need to be evaluated.
+ * Solutions found by other threads are used as a less strict bound: they
+ * may have been found later in search order, so candidates that merely
+ * tie with them must still be evaluated.
+ */
+class best_collector {
+ public:
+  best_collector(
+      hardware_limits const& limits,
+      find algorithm,
+      shared_best* shared = nullptr)
+      : limits_{limits}
+      , algorithm_{algorithm}
+      , shared_{shared} {}
+
+  step operator()(solution const& sol) {
+    add(sol);
+
+    auto fnd = solution_quality(sol, limits_);
+
+    if (!found_ or fnd > *found_) {
+      found_ = fnd;
+    }
+
+    return done() ? step::last_fosc : step::next;
+  }
+
+  // The smallest fGPS for a candidate that may still change the result
+  int64_t min_fGPS(candidate const& c) const {
+    if (algorithm_ != find::best) {
+      return 0;
+    }
+
+    std::optional<double> gt;
+
+    if (best_) {
+      gt = f3_key(best_->fGPS, best_->N31);
+    }
+
+    return fGPS_threshold(f3_rank{limits_.GPS_HI}, c, gt, load(shared_));
+  }
+
+  void merge(best_collector const& other) {
+    if (other.best_) {
+      add(*other.best_);
+    }
+    if (other.found_ and (!found_ or *other.found_ > *found_)) {
+      found_ = other.found_;
+    }
+  }
+
+  bool done() const { return found_ and *found_ >= algorithm_; }
+
+  std::vector<solution> solutions() const {
+    if (best_) {
+      return {*best_};
+    }
+    return {};
+  }
+
+ private:
+  void add(solution const& sol) {
+    if (!best_ or sol < *best_) {
+      best_ = sol;
+
+      if (shared_) {
+        publish(*shared_, f3_key(sol.fGPS, sol.N31));
+      }
+    }
+  }
+
+  hardware_limits const& limits_;
+  find const algorithm_;
+  shared_best* const shared_;
+  std::optional<solution> best_;
+  std::optional<find> found_;
+};
+
+/**
+ * Keep track of the `k` best solutions for find::top_k
+ *
+ * The solutions are kept in a heap with the worst one on top, ordered by
+ * their key for `Rank` and then by search order, so the result is identical
+ * to the first `k` solutions of find::all. Once the heap is full, its worst
+ * solution is used to prune the search just like the best solution for
+ * find::best. With a cost model, this is also used for find::best.
+ *
+ * Each solution is tagged with its position in search order, starting at
+ * `seq_base`. When searching chunks in parallel, this must increase with
+ * the chunk index so the collectors can be merged.
+ */
+template <typename Rank>
+class top_k_collector {
+ public:
+  top_k_collector(
+      Rank const& rank,
+      size_t k,
+      uint64_t seq_base,
+      shared_best* shared = nullptr,
+      std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+      : rank_{rank}
+      , k_{k}
+      , seq_{seq_base}
+      , shared_{shared}
+      , heap_{memory} {
+    // `k` can be anything a user asks for, so let larger heaps grow
+    heap_.reserve(std::min(k_, MAX_RESERVE));
+  }
+
+  step operator()(solution const& sol) {
+    add({rank_.key(candidate_of(sol), sol.fGPS), seq_++, sol});
+    return step::next;
+  }
+
+  int64_t min_fGPS(candidate const& c) const {
+    std::optional<double> gt;
+
+    if (full()) {
+      gt = heap_.front().key;
+    }
+
+    return fGPS_threshold(rank_, c, gt, load(shared_));
+  }
+
+  void merge(top_k_collector const& other) {
+    for (auto const& e : other.heap_) {
+      add(e);
+    }
+  }
+
+  std::vector<solution> solutions() const {
+    std::pmr::vector<entry> entries(heap_, heap_.get_allocator());
+    std::sort(entries.begin(), entries.end(), better);
+    std::vector<solution> v;
+    v.reserve(entries.size());
+    for (auto const& e : entries) {
+      v.push_back(e.sol);
+    }
+    return v;
+  }
+
+ private:
+  struct entry {
+    double key;
+    uint64_t seq;
+    solution sol;
+  };
+
+  static constexpr size_t MAX_RESERVE = 1024;
+
+  static bool better(entry const& a, entry const& b) {
+    return a.key > b.key or (a.key == b.key and a.seq < b.seq);
+  }
+
+  bool full() const { return k_ > 0 and heap_.size() == k_; }
+
+  void add(entry const& e) {
+    if (!full()) {
+      heap_.push_back(e);
+      std::push_heap(heap_.begin(), heap_.end(), better);
+    } else if (better(e, heap_.front())) {
+      std::pop_heap(heap_.begin(), heap_.end(), better);
+      heap_.back() = e;
+      std::push_heap(heap_.begin(), heap_.end(), better);
+    } else {
+      return;
+    }
+
+    if (shared_ and full()) {
+      publish(*shared_, heap_.front().key);
+    }
+  }
+
+  Rank const rank_;
+  size_t const k_;
+  uint64_t seq_;
+  shared_best* const shared_;
+  std::pmr::vector<entry> heap_;
+};
+
+/**
+ * The order of `keys` from highest to lowest, with ties in their original
+ * order, just like std::stable_sort() would produce
+ *
+ * This is an LSD radix sort on the bits of the keys, which takes linear
+ * time and is several times faster than sorting by comparison for the
+ * large numbers of solutions that find::all can return. Digits that are
+ * the same for all keys are skipped, which, as solutions of one search
+ * have keys of a similar magnitude, includes most of the exponent.
+ */
+std::pmr::vector<size_t>
+sort_order(std::span<double const> keys, std::pmr::memory_resource* memory) {
+  struct item {
+    uint64_t key;
+    size_t index;
+  };
+
+  size_t constexpr DIGITS = sizeof(uint64_t);
+  std::pmr::vector<item> items(keys.size(), memory);
+  std::pmr::vector<item> tmp(keys.size(), memory);
+  std::array<std::array<size_t, 256>, DIGITS> counts{};
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    // Map to an integer that sorts in the opposite order of the key,
+    // with -0.0 and 0.0 mapped to the same value.
+    auto const bits = std::bit_cast<uint64_t>(keys[i] == 0 ? 0.0 : keys[i]);
+    auto const sign = uint64_t{1} << 63;
+    auto const key = bits & sign ? bits : ~(bits | sign);
+
+    items[i] = {key, i};
+
+    for (size_t d = 0; d < DIGITS; ++d) {
+      ++counts[d][(key >> (8 * d)) & 0xff];
+    }
+  }
+
+  for (size_t d = 0; d < DIGITS; ++d) {
+    auto& c = counts[d];
+
+    if (std::ranges::find(c, keys.size()) != c.end()) {
+      continue;
+    }
+
+    size_t pos = 0;
+
+    for (auto& n : c) {
+      pos += std::exchange(n, pos);
+    }
+
+    for (auto const& it : items) {
+      tmp[c[(it.key >> (8 * d)) & 0xff]++] = it;
+    }
+
+    items.swap(tmp);
+  }
+
+  std::pmr::vector<size_t> order(memory);
+  order.reserve(items.size());
+
+  for (auto const& it : items) {
+    order.push_back(it.index);
+  }
+
+  return order;
+}
+
+/**
+ * Sort the solutions of find::all, which were collected in search order
+ */
+std::vector<solution> sort_all(search_space const& sp, solution_set& all) {
+  if (!sp.cost) {
+    all.sort();
+    return all.to_vector();
+  }
+
+  cost_rank const rank(*sp.cost, sp.limits, sp.f1);
+  std::pmr::vector<double> keys(sp.memory);
+
+  keys.reserve(all.size());
+
+  for (auto const& sol : all) {
+    keys.push_back(rank.key(candidate_of(sol), sol.fGPS));
+  }
+
+  auto const order = sort_order(keys, sp.memory);
+  std::vector<solution> v;
+  v.reserve(order.size());
+
+  for (auto i : order) {
+    v.push_back(all[i]);
+  }
+
+  return v;
+}
+
+/**
+ * Whether `algorithm` keeps the `k` best solutions, and how many
+ */
+std::optional<size_t>
+top_k_of(search_space const& sp, find algorithm, search_options const& opts) {
+  if (algorithm == find::top_k) {
+    return opts.top_k;
+  }
+  if (algorithm == find::best and sp.cost) {
+    return 1;
+  }
+  return std::nullopt;
+}
+
+std::vector<solution> find_solutions_parallel(
+    search_space const& sp,
+    find algorithm,
+    search_options const& options,
+    unsigned threads) {
+  auto* const stats = options.stats;
+  auto const chunks = make_chunks(sp);
+  std::vector<solver_stats> chunk_stats(stats ? chunks.size() : 0);
+  std::vector<solution> solutions;
+
+  auto chunk_stats_of = [&](size_t i) {
+    return stats ? &chunk_stats[i] : nullptr;
+  };
+
+  if (algorithm == find::all) {
+    std::vector<solution_set> results(chunks.size());
+
+    parallel_for(chunks.size(), threads, [&](size_t i) {
+      auto collect = [&](solution const& sol) {
+        results[i].push_back(sol);
+        return step::next;
+      };
+
+      with_stats(chunk_stats_of(i), collect, [&](auto& visit) {
+        return visit_chunk(sp, chunks[i], visit);
+      });
+    });
+
+    size_t total = 0;
+
+    for (auto const& r : results) {
+      total += r.size();
+    }
+
+    solution_set all;
+    all.reserve(total);
+
+    for (auto& r : results) {
+      all.append(std::move(r));
+    }
+
+    solutions = sort_all(sp, all);
+  } else if (auto const k = top_k_of(sp, algorithm, options)) {
+    solutions = with_rank(sp, [&](auto const& rank) {
+      // Chunk results are merged as soon as they are available, so only
+      // one collector per thread is alive at any time.
+      top_k_collector top(rank, *k, 0);
+      shared_best shared{no_key};
+      std::mutex mx;
+
+      parallel_for(chunks.size(), threads, [&](size_t i) {
+        top_k_collector tc(rank, *k, uint64_t{i} << 40, &shared);
+
+        with_stats(chunk_stats_of(i), tc, [&](auto& visit) {
+          return visit_chunk(sp, chunks[i], visit);
+        });
+
+        std::lock_guard lock(mx);
+        top.merge(tc);
+      });
+
+      return top.solutions();
+    });
+  } else {
+    // Chunks after the first one that satisfies `algorithm` are irrelevant
+    // for the result, so we don't need to search them.
+    std::vector<std::optional<best_collector>> results(chunks.size());
+    std::atomic<size_t> first_done{chunks.size()};
+    shared_best shared{no_key};
+
+    parallel_for(chunks.size(), threads, [&](size_t i) {
+      if (i > first_done) {
+        return;
+      }
+
+      auto& bc = results[i].emplace(sp.limits, algorithm, &shared);
+
+      with_stats(chunk_stats_of(i), bc, [&](auto& visit) {
+        return visit_chunk(sp, chunks[i], visit);
+      });
+
+      if (bc.done()) {
+        auto cur = first_done.load();
+        while (i < cur and !first_done.compare_exchange_weak(cur, i)) {
+        }
+      }
+    });
+
+    best_collector bc(sp.limits, algorithm);
+
+    for (size_t i = 0; i < chunks.size() and i <= first_done; ++i) {
+      bc.merge(*results[i]);
+    }
+
+    solutions = bc.solutions();
+  }
+
+  for (auto const& cs : chunk_stats) {
+    *stats += cs;
+  }
+
+  return solutions;
+}
+
+} // namespace
+
+void solution::write(std::ostream& os, bool verbose) const {
+  os << "fGPS = " << fGPS << ", N31 = " << N31 << ", N1_HS = " << N1_HS
+     << ", NC1_LS = " << NC1_LS << ", NC2_LS = " << NC2_LS
+     << ", N2_HS = " << N2_HS << ", N2_LS = " << N2_LS;
+
+  if (verbose) {
+    auto f3 = rat64{fGPS, N31};
+    auto fOSC = f3 * N2_HS * N2_LS;
+    auto f1 = fOSC / (N1_HS * NC1_LS);
+    auto f2 = fOSC / (N1_HS * NC2_LS);
+    os << " [f3 = " << boost::rational_cast<double>(f3)
+       << ", fOSC = " << boost::rational_cast<double>(fOSC)
+       << ", f1 = " << boost::rational_cast<double>(f1)
+       << ", f2 = " << boost::rational_cast<double>(f2) << "]";
+  }
+}
+
+void multi_solution::write(std::ostream& os, bool verbose) const {
+  os << "fGPS = " << fGPS << ", N31 = " << N31 << ", N1_HS = " << N1_HS;
+
+  for (size_t i = 0; i < NC_LS.size(); ++i) {
+    os << ", NC" << i + 1 << "_LS = " << NC_LS[i];
+  }
+
+  os << ", N2_HS = " << N2_HS << ", N2_LS = " << N2_LS;
+
+  if (verbose) {
+    auto f3 = rat64{fGPS, N31};
+    auto fOSC = f3 * N2_HS * N2_LS;
+    os << " [f3 = " << boost::rational_cast<double>(f3)
+       << ", fOSC = " << boost::rational_cast<double>(fOSC);
+
+    for (size_t i = 0; i < NC_LS.size(); ++i) {
+      os << ", out" << i + 1 << " = "
+         << boost::rational_cast<double>(fOSC / (N1_HS * NC_LS[i]));
+    }
+
+    os << "]";
+  }
+}
+
+// This allows sorting solutions in order of decreasing PLL frequency f3.
+bool solution::operator<(solution const& rhs) const {
+  return static_cast<double>(fGPS) / N31
+         > static_cast<double>(rhs.fGPS) / rhs.N31;
+}
+
+double cost_model::cost(
+    solution const& sol, rat64 f1, hardware_limits const& limits) const {
+  return cost_of(
+      *this, limits, boost::rational_cast<double>(f1), candidate_of(sol),
+      sol.fGPS);
+}
+
+// Layout of the packed fields (bit widths follow the hardware limits):
+//
+//   lo: fGPS[0..31] N31[32..51] N1_HS[52..55] N2_HS[56..59]
+//   hi: NC1_LS[0..20] NC2_LS[21..41] N2_LS[42..62]
+void solution_set::reserve(size_t n) {
+  keys_.reserve(n);
+  fields_.reserve(n);
+}
+
+void solution_set::push_back(solution const& sol) {
+  assert(sol.N31 < (1 << 20));
+  assert(sol.N1_HS < 16 and sol.N2_HS < 16);
+  assert(sol.NC1_LS < (1 << 21) and sol.NC2_LS < (1 << 21));
+  assert(sol.N2_LS < (1 << 21));
+
+  keys_.push_back(f3_key(sol.fGPS, sol.N31));
+  fields_.push_back({
+      .lo = uint64_t{sol.fGPS} | (uint64_t{sol.N31} << 32)
+            | (uint64_t{sol.N1_HS} << 52) | (uint64_t{sol.N2_HS} << 56),
+      .hi = uint64_t{sol.NC1_LS} | (uint64_t{sol.NC2_LS} << 21)
+            | (uint64_t{sol.N2_LS} << 42),
+  });
+}
+
+void solution_set::append(solution_set&& other) {
+  keys_.insert(keys_.end(), other.keys_.begin(), other.keys_.end());
+  fields_.insert(fields_.end(), other.fields_.begin(), other.fields_.end());
+  other = solution_set(other.keys_.get_allocator().resource());
+}
+
+solution solution_set::operator[](size_t i) const {
+  auto const& p = fields_[i];
+  return {
+      .fGPS = static_cast<uint32_t>(p.lo),
+      .N31 = static_cast<uint32_t>((p.lo >> 32) & 0xFFFFF),
+      .N1_HS = static_cast<uint32_t>((p.lo >> 52) & 0xF),
+      .NC1_LS = static_cast<uint32_t>(p.hi & 0x1FFFFF),
+      .NC2_LS = static_cast<uint32_t>((p.hi >> 21) & 0x1FFFFF),
+      .N2_HS = static_cast<uint32_t>((p.lo >> 56) & 0xF),
+      .N2_LS = static_cast<uint32_t>((p.hi >> 42) & 0x1FFFFF),
+  };
+}
+
+void solution_set::sort() {
+  if (size() < 2) {
+    return;
+  }
+
+  auto* const memory = keys_.get_allocator().resource();
+  auto const order = sort_order(keys_, memory);
+  std::pmr::vector<double> keys(memory);
+  std::pmr::vector<packed> fields(memory);
+
+  keys.reserve(keys_.size());
+  fields.reserve(fields_.size());
+
+  for (auto i : order) {
+    keys.push_back(keys_[i]);
+    fields.push_back(fields_[i]);
+  }
+
+  keys_.swap(keys);
+  fields_.swap(fields);
+}
+
+std::vector<solution> solution_set::to_vector() const {
+  std::vector<solution> v;
+  v.reserve(size());
+  for (size_t i = 0; i < size(); ++i) {
+    v.push_back((*this)[i]);
+  }
+  return v;
+}
+
+namespace {
+
+using counter_field = uint64_t solver_stats::counters::*;
+
+struct {
+  char const* name;
+  counter_field field;
+} const counter_fields[] = {
+    {"q_values", &solver_stats::counters::q_values},
+    {"fosc_duplicates", &solver_stats::counters::fosc_duplicates},
+    {"fosc_memo_hits", &solver_stats::counters::fosc_memo_hits},
+    {"N31_candidates", &solver_stats::counters::N31_candidates},
+    {"factor_calls", &solver_stats::counters::factor_calls},
+    {"rejected_N31_range", &solver_stats::counters::rejected_N31_range},
+    {"rejected_bound", &solver_stats::counters::rejected_bound},
+    {"rejected_no_factor", &solver_stats::counters::rejected_no_factor},
+    {"rejected_N2_LS_range", &solver_stats::counters::rejected_N2_LS_range},
+    {"rejected_F3_range", &solver_stats::counters::rejected_F3_range},
+    {"solutions", &solver_stats::counters::solutions},
+};
+
+double to_ms(std::chrono::nanoseconds t) {
+  return std::chrono::duration<double, std::milli>(t).count();
+}
+
+void write_counters(
+    std::ostream& os, solver_stats::counters const& c, bool json) {
+  if (json) {
+    os << "{";
+    for (auto const& f : counter_fields) {
+      os << "\"" << f.name << "\": " << c.*f.field << ", ";
+    }
+    os << "\"factor_time_ms\": " << to_ms(c.factor_time) << "}";
+  } else {
+    for (auto const& f : counter_fields) {
+      os << "  " << std::left << std::setw(22) << f.name << std::right
+         << std::setw(14) << c.*f.field << "\n";
+    }
+    os << "  " << std::left << std::setw(22) << "factor_time_ms"
+       << std::right << std::setw(14) << to_ms(c.factor_time) << "\n";
+  }
+}
+
+} // namespace
+
+solver_stats::counters&
+solver_stats::counters::operator+=(counters const& rhs) {
+  for (auto const& f : counter_fields) {
+    this->*f.field += rhs.*f.field;
+  }
+  factor_time += rhs.factor_time;
+  return *this;
+}
+
+solver_stats::counters solver_stats::total() const {
+  counters t;
+  for (auto const& [N1_HS, c] : by_N1_HS) {
+    t += c;
+  }
+  return t;
+}
+
+solver_stats& solver_stats::operator+=(solver_stats const& rhs) {
+  for (auto const& [N1_HS, c] : rhs.by_N1_HS) {
+    by_N1_HS[N1_HS] += c;
+  }
+  elapsed += rhs.elapsed;
+  return *this;
+}
+
+void solver_stats::write(std::ostream& os, bool json) const {
+  if (json) {
+    os << "{\"elapsed_ms\": " << to_ms(elapsed) << ", \"total\": ";
+    write_counters(os, total(), true);
+    os << ", \"by_N1_HS\": {";
+    for (auto it = by_N1_HS.rbegin(); it != by_N1_HS.rend(); ++it) {
+      os << (it == by_N1_HS.rbegin() ? "" : ", ") << "\"" << it->first
+         << "\": ";
+      write_counters(os, it->second, true);
+    }
+    os << "}}";
+  } else {
+    os << "elapsed_ms: " << to_ms(elapsed) << "\ntotal:\n";
+    write_counters(os, total(), false);
+    for (auto it = by_N1_HS.rbegin(); it != by_N1_HS.rend(); ++it) {
+      os << "N1_HS = " << it->first << ":\n";
+      write_counters(os, it->second, false);
+    }
+  }
+}
+
+namespace {
+
+std::vector<solution> find_solutions_in(
+    search_space sp,
+    find algorithm,
+    search_options const& options,
+    std::chrono::steady_clock::time_point start) {
+  auto const threads = resolve_threads(options.threads);
+  auto* const stats = options.stats;
+  std::atomic<bool> expired{false};
+
+  sp.expired = &expired;
+
+  if (stats) {
+    *stats = {};
+  }
+
+  std::vector<solution> solutions;
+
+  auto run = [&](auto& visitor) {
+    with_stats(
+        stats, visitor, [&](auto& visit) { return search(sp, visit); });
+  };
+
+  if (check_feasibility(sp) != infeasibility::none) {
+    // Nothing to search
+  } else if (threads > 1) {
+    solutions = find_solutions_parallel(sp, algorithm, options, threads);
+  } else if (algorithm == find::all) {
+    solution_set all(sp.memory);
+
+    auto collect = [&](solution const& sol) {
+      all.push_back(sol);
+      return step::next;
+    };
+
+    run(collect);
+    solutions = sort_all(sp, all);
+  } else if (auto const k = top_k_of(sp, algorithm, options)) {
+    solutions = with_rank(sp, [&](auto const& rank) {
+      top_k_collector tc(rank, *k, 0, nullptr, sp.memory);
+      run(tc);
+      return tc.solutions();
+    });
+  } else {
+    best_collector bc(sp.limits, algorithm);
+    run(bc);
+    solutions = bc.solutions();
+  }
+
+  if (stats) {
+    stats->elapsed = std::chrono::steady_clock::now() - start;
+  }
+
+  if (options.timed_out) {
+    *options.timed_out = expired;
+  }
+
+  return solutions;
+}
+
+} // namespace
+
+void check_limits(hardware_limits const& limits) {
+  int64_t constexpr VCO_MAX = 10'000'000'000;
+  int64_t constexpr F_MAX = 1'000'000'000;
+
+  if (limits.VCO_LO <= 0 or limits.VCO_LO > limits.VCO_HI
+      or limits.VCO_HI > VCO_MAX) {
+    throw std::invalid_argument("VCO limits out of range");
+  }
+
+  if (limits.F3_LO <= 0 or limits.F3_LO > limits.F3_HI
+      or limits.F3_HI > F_MAX) {
+    throw std::invalid_argument("F3 limits out of range");
+  }
+
+  if (limits.GPS_HI <= 0 or limits.GPS_HI > F_MAX) {
+    throw std::invalid_argument("GPS limit out of range");
+  }
+}
+
+std::vector<solution> find_solutions(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    find algorithm,
+    search_options const& options) {
+  auto const start = std::chrono::steady_clock::now();
+  return find_solutions_in(
+      make_search_space(f1, f2, limits, options), algorithm, options, start);
+}
+
+char const* describe(infeasibility reason) {
+  switch (reason) {
+  case infeasibility::none:
+    return "solutions may exist";
+  case infeasibility::VCO_range:
+    return "the VCO range can't be reached with the available output "
+           "dividers";
+  case infeasibility::N31_range:
+    return "no VCO frequency allows N31 to be in range";
+  }
+
+  return "unknown";
+}
+
+infeasibility
+check_feasibility(rat64 f1, rat64 f2, hardware_limits const& limits) {
+  return check_feasibility(make_search_space(f1, f2, limits, {}));
+}
+
+std::vector<multi_solution> find_solutions(
+    std::span<output_spec const> outputs,
+    hardware_limits const& limits,
+    find algorithm,
+    search_options const& options) {
+  auto const start = std::chrono::steady_clock::now();
+  auto sp = make_search_space(outputs, limits, options);
+  std::vector<int64_t> divs;
+
+  for (auto const& o : outputs) {
+    divs.push_back(lcm_div(sp.fLCM, o.f));
+  }
+
+  auto const solutions
+      = find_solutions_in(std::move(sp), algorithm, options, start);
+  std::vector<multi_solution> rv;
+  rv.reserve(solutions.size());
+
+  for (auto const& sol : solutions) {
+    auto const q = sol.NC1_LS / divs.front();
+    std::vector<uint32_t> NC_LS;
+    NC_LS.reserve(divs.size());
+
+    for (auto d : divs) {
+      NC_LS.push_back(boost::numeric_cast<uint32_t>(q * d));
+    }
+
+    rv.push_back({
+        .fGPS = sol.fGPS,
+        .N31 = sol.N31,
+        .N1_HS = sol.N1_HS,
+        .N2_HS = sol.N2_HS,
+        .N2_LS = sol.N2_LS,
+        .NC_LS = std::move(NC_LS),
+    });
+  }
+
+  return rv;
+}
+
+struct solver::impl {
+  rat64 f1;
+  hardware_limits limits;
+  fosc_memo memo;
+};
+
+solver::solver(rat64 f1, hardware_limits const& limits)
+    : impl_{std::make_unique<impl>(f1, limits)} {}
+
+solver::~solver() = default;
+
+rat64 solver::f1() const { return impl_->f1; }
+
+hardware_limits const& solver::limits() const { return impl_->limits; }
+
+size_t solver::memo_size() const { return impl_->memo.size(); }
+
+std::vector<solution> solver::find_solutions(
+    rat64 f2, find algorithm, search_options const& options) {
+  auto const start = std::chrono::steady_clock::now();
+  auto sp = make_search_space(impl_->f1, f2, impl_->limits, options);
+
+  // find::{any,good} usually stop after very few fOSC values, too few for
+  // the memo to pay off.
+  if (algorithm != find::any and algorithm != find::good) {
+    sp.memo = &impl_->memo;
+  }
+
+  return find_solutions_in(std::move(sp), algorithm, options, start);
+}
+
+namespace {
+
+void append_digit(int64_t& n, int dig) {
+  if (__builtin_mul_overflow(n, 10, &n) or __builtin_add_overflow(n, dig, &n)) {
+    throw std::invalid_argument("number too large");
+  }
+}
+
+} // namespace
+
+rat64 parse_fraction(std::string const& str) {
+  int64_t num = 0, den = 1, integral = 0, unit = 1;
+  bool decimal = false, blank = false, frac = false;
+
+  for (auto s : str) {
+    if (s == '.') {
+      if (decimal or blank or frac) {
+        throw std::invalid_argument("invalid input");
+      }
+      decimal = true;
+    } else if (s == ' ' || s == '_') {
+      if (decimal or blank or frac) {
+        throw std::invalid_argument("invalid input");
+      }
+      blank = true;
+      integral = num;
+      num = 0;
+    } else if (s == '/') {
+      if (decimal or frac) {
+        throw std::invalid_argument("invalid input");
+      }
+      frac = true;
+      den = 0;
+    } else if (s == 'k') {
+      if (unit != 1) {
+        throw std::invalid_argument("invalid input");
+      }
+      unit = 1'000;
+    } else if (s == 'M') {
+      if (unit != 1) {
+        throw std::invalid_argument("invalid input");
+      }
+      unit = 1'000'000;
+    } else if (std::isdigit(s)) {
+      int dig = (s - '0');
+
+      if (frac) {
+        append_digit(den, dig);
+      } else {
+        append_digit(num, dig);
+
+        if (decimal) {
+          append_digit(den, 0);
+        }
+      }
+    } else {
+      throw std::invalid_argument("invalid input");
+    }
+  }
+
+  if (den == 0) {
+    throw std::invalid_argument("invalid input");
+  }
+
+  auto const r = rat64(num, den);
+
+  // (r + integral) * unit, which can overflow like the digits above
+  int64_t wide_num;
+
+  if (__builtin_mul_overflow(integral, r.denominator(), &wide_num)
+      or __builtin_add_overflow(wide_num, r.numerator(), &wide_num)) {
+    throw std::invalid_argument("number too large");
+  }
+
+  auto const sum = rat64(wide_num, r.denominator());
+  auto const g = std::gcd(unit, sum.denominator());
+
+  if (__builtin_mul_overflow(sum.numerator(), unit / g, &wide_num)) {
+    throw std::invalid_argument("number too large");
+  }
+
+  return rat64(wide_num, sum.denominator() / g);
+}
+
+bool for_each_solution(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    solution_visitor const& visitor) {
+  auto const sp = make_search_space(f1, f2, limits, {});
+
+  if (check_feasibility(sp) != infeasibility::none) {
+    return true;
+  }
+
+  return search(sp, [&](solution const& sol) {
+    return visitor(sol) ? step::next : step::stop;
+  });
+}
+
+bool for_each_sorted_solution(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    solution_visitor const& visitor,
+    search_options const& options) {
+  // Small batches cover the first page of results; after that a single
+  // find::all search is cheaper than more rounds of find::top_k.
+  size_t constexpr FIRST_BATCH = 64;
+  size_t constexpr BATCH_GROWTH = 8;
+  size_t constexpr LAST_BATCH = 1 << 9;
+
+  solver_stats batch_stats;
+  auto opts = options;
+  size_t visited = 0;
+
+  opts.timeout = std::chrono::nanoseconds::zero();
+  opts.timed_out = nullptr;
+
+  if (options.stats) {
+    *options.stats = {};
+    opts.stats = &batch_stats;
+  }
+
+  if (options.timed_out) {
+    *options.timed_out = false;
+  }
+
+  for (size_t k = FIRST_BATCH;; k *= BATCH_GROWTH) {
+    auto const start = std::chrono::steady_clock::now();
+    auto const algorithm = k > LAST_BATCH ? find::all : find::top_k;
+
+    opts.top_k = k;
+
+    auto const solutions = find_solutions_in(
+        make_search_space(f1, f2, limits, opts), algorithm, opts, start);
+
+    if (options.stats) {
+      *options.stats += batch_stats;
+    }
+
+    for (size_t i = visited; i < solutions.size(); ++i) {
+      if (!visitor(solutions[i])) {
+        return false;
+      }
+    }
+
+    if (algorithm == find::all or solutions.size() < k) {
+      return true;
+    }
+
+    visited = solutions.size();
+  }
 }
 
 } // namespace gpsdo_config
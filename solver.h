@@ -21,8 +21,18 @@
  * along with gpsdo-config.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
+#include <compare>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
 #include <ostream>
+#include <span>
+#include <string>
 #include <vector>
 
 #include <boost/rational.hpp>
@@ -37,8 +47,42 @@ struct hardware_limits {
   int64_t F3_LO;
   int64_t F3_HI;
   int64_t GPS_HI;
+
+  bool operator==(hardware_limits const&) const = default;
+};
+
+// The limits of the Si53xx chips used in GPSDOs
+inline constexpr hardware_limits si53xx_limits{
+    // Source: Silicon Labs Si53xx-RM Rev. 1.3, Table 26
+    .VCO_LO = 4'850'000'000,
+    .VCO_HI = 5'670'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+
+    // Source: ublox MAX-M8 series data sheet
+    .GPS_HI = 10'000'000,
+};
+
+// Relaxed VCO limits that are known to work in practice
+inline constexpr hardware_limits si53xx_relaxed_limits{
+    // Source: lb-gps-linux source code
+    .VCO_LO = 3'500'000'000,
+    .VCO_HI = 6'500'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+
+    // Source: ublox MAX-M8 series data sheet
+    .GPS_HI = 10'000'000,
 };
 
+/**
+ * Throws std::invalid_argument unless each pair of limits is ordered and
+ * within 0 < VCO <= 10 GHz, 0 < F3 <= 1 GHz and 0 < GPS_HI <= 1 GHz. No
+ * Si53xx comes close to these, and the search relies on them to keep its
+ * 64-bit arithmetic from overflowing. All searches check the limits.
+ */
+void check_limits(hardware_limits const& limits);
+
 struct solution {
   uint32_t fGPS;
   uint32_t N31;
@@ -50,14 +94,394 @@ struct solution {
 
   void write(std::ostream& os, bool verbose = false) const;
   bool operator<(solution const&) const;
+  bool operator==(solution const&) const = default;
+};
+
+/**
+ * Compact container for large numbers of solutions
+ *
+ * The fields of each solution are packed into 16 bytes instead of 28 and
+ * stored apart from a precomputed f3 sort key, so sort() only ever moves
+ * keys around. Elements are accessed as `solution` values.
+ */
+class solution_set {
+ public:
+  class const_iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type = solution;
+    using difference_type = std::ptrdiff_t;
+    using reference = solution;
+
+    const_iterator() = default;
+    const_iterator(solution_set const* set, size_t index)
+        : set_{set}
+        , index_{index} {}
+
+    solution operator*() const { return (*set_)[index_]; }
+    solution operator[](difference_type n) const { return *(*this + n); }
+
+    const_iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto tmp = *this;
+      ++index_;
+      return tmp;
+    }
+    const_iterator& operator--() {
+      --index_;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      auto tmp = *this;
+      --index_;
+      return tmp;
+    }
+    const_iterator& operator+=(difference_type n) {
+      index_ += n;
+      return *this;
+    }
+    const_iterator& operator-=(difference_type n) {
+      index_ -= n;
+      return *this;
+    }
+
+    friend const_iterator operator+(const_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend const_iterator operator+(difference_type n, const_iterator it) {
+      return it += n;
+    }
+    friend const_iterator operator-(const_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type
+    operator-(const_iterator const& a, const_iterator const& b) {
+      return static_cast<difference_type>(a.index_ - b.index_);
+    }
+
+    bool operator==(const_iterator const& rhs) const {
+      return index_ == rhs.index_;
+    }
+    auto operator<=>(const_iterator const& rhs) const {
+      return index_ <=> rhs.index_;
+    }
+
+   private:
+    solution_set const* set_{nullptr};
+    size_t index_{0};
+  };
+
+  solution_set() = default;
+  explicit solution_set(std::pmr::memory_resource* memory)
+      : keys_{memory}
+      , fields_{memory} {}
+
+  void reserve(size_t n);
+  void push_back(solution const& sol);
+  void append(solution_set&& other);
+
+  // Sort in order of decreasing f3, yielding exactly the same order as
+  // std::stable_sort() using solution::operator<.
+  void sort();
+
+  size_t size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+  solution operator[](size_t i) const;
+
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, size()}; }
+
+  std::vector<solution> to_vector() const;
+
+ private:
+  struct packed {
+    uint64_t lo;
+    uint64_t hi;
+  };
+
+  std::pmr::vector<double> keys_;
+  std::pmr::vector<packed> fields_;
+};
+
+enum class find { any, good, best, all, top_k };
+
+/**
+ * Counters describing the work done by a single find_solutions() call
+ *
+ * Meant for diagnosing slow cases. Collecting them is only done if asked
+ * for through search_options::stats, otherwise the search is unaffected.
+ */
+struct solver_stats {
+  struct counters {
+    // (N1_HS, q) combinations, and how many of them were skipped because
+    // their fOSC had already been visited.
+    uint64_t q_values{0};
+    uint64_t fosc_duplicates{0};
+
+    // fOSC values whose PLL configurations were reused by a `solver`
+    uint64_t fosc_memo_hits{0};
+
+    // (N2_HS, k) combinations, i.e. N31 candidates, examined
+    uint64_t N31_candidates{0};
+
+    // Searches for the largest fGPS that divides the numerator of f3_N2,
+    // and the time spent in them (summed across threads)
+    uint64_t factor_calls{0};
+    std::chrono::nanoseconds factor_time{0};
+
+    // Candidates rejected, by reason
+    uint64_t rejected_N31_range{0};
+    uint64_t rejected_bound{0};
+    uint64_t rejected_no_factor{0};
+    uint64_t rejected_N2_LS_range{0};
+    uint64_t rejected_F3_range{0};
+
+    // Solutions passed to the collector, which for anything but find::all
+    // only keeps the best of them
+    uint64_t solutions{0};
+
+    counters& operator+=(counters const& rhs);
+  };
+
+  // Counters for each N1_HS and their total
+  std::map<uint32_t, counters> by_N1_HS;
+  counters total() const;
+
+  // Wall clock time of the whole find_solutions() call
+  std::chrono::nanoseconds elapsed{0};
+
+  solver_stats& operator+=(solver_stats const& rhs);
+
+  void write(std::ostream& os, bool json = false) const;
 };
 
-enum class find { any, good, best, all };
+/**
+ * Weights for ranking solutions by more than just their PLL frequency f3
+ *
+ * The cost of a solution is the weighted sum of the terms below, each of
+ * which is between 0 for the ideal and 1 for the worst value. Solutions
+ * with a lower cost are better, and solutions with the same cost are
+ * ordered like for find::all. All weights must be non-negative.
+ */
+struct cost_model {
+  // 1 - f3 / F3_HI, a higher f3 means less jitter
+  double f3{1};
+
+  // 1 - distance of fOSC from the nearer VCO limit, relative to half the
+  // VCO range
+  double vco_margin{0};
+
+  // How far N1_HS and N2_HS are from their maximum, relative to their
+  // range, as larger high-speed dividers need less power
+  double power{0};
+
+  // 1 - fGPS / GPS_HI
+  double gps{0};
+
+  double
+  cost(solution const& sol, rat64 f1, hardware_limits const& limits) const;
+};
+
+// Arithmetic used in the inner loops of the search. `rational` is the
+// (slower) reference implementation, both produce identical results.
+enum class arith { integer, rational };
+
+struct search_options {
+  // Number of threads to use for the search, 0 means one per CPU core.
+  // Results are identical regardless of the number of threads.
+  unsigned threads{1};
+
+  arith arithmetic{arith::integer};
+
+  // Number of solutions to return for find::top_k. These are the same as
+  // the first `top_k` solutions returned for find::all, 0 means all of them.
+  size_t top_k{10};
+
+  // If not null, filled with counters describing the search.
+  solver_stats* stats{nullptr};
+
+  // If not null, all scratch memory of a single-threaded search is taken
+  // from this resource instead of the heap. With an arena that is reused
+  // between calls, e.g. a std::pmr::monotonic_buffer_resource, a search
+  // doesn't allocate anything but the returned solutions. Ignored unless
+  // `threads` is 1, as the resource isn't required to be thread safe.
+  std::pmr::memory_resource* memory{nullptr};
+
+  // If not zero, the search stops after roughly this much time and returns
+  // the best solutions found until then.
+  std::chrono::nanoseconds timeout{0};
 
+  // If not null, set to whether the search was stopped by `timeout`. Only
+  // if not, the solutions are known to be the best (or all) solutions.
+  bool* timed_out{nullptr};
+
+  // If not null, find::{best,top_k,all} rank solutions by this model
+  // instead of by f3. The search is pruned by cost just like it is by
+  // f3. Throws std::invalid_argument if a weight is negative.
+  cost_model const* cost{nullptr};
+};
+
+// Throws std::invalid_argument if f1 or f2 isn't positive
 std::vector<solution> find_solutions(
     rat64 f1,
     rat64 f2,
     hardware_limits const& limits,
-    find algorithm = find::any);
+    find algorithm = find::any,
+    search_options const& options = {});
+
+// Why a pair of frequencies cannot have any solutions
+enum class infeasibility {
+  none,      // solutions may exist, but aren't guaranteed to
+  VCO_range, // the VCO range can't be reached with the output dividers
+  N31_range, // no VCO frequency allows N31 to be in range
+};
+
+char const* describe(infeasibility reason);
+
+/**
+ * Check if a pair of frequencies can have any solutions at all
+ *
+ * This only looks at the bounds of the search space, and takes
+ * microseconds where a search can take much longer to find nothing.
+ * find_solutions() does the same check, so calling this first is only
+ * useful to learn why there are no solutions.
+ */
+infeasibility
+check_feasibility(rat64 f1, rat64 f2, hardware_limits const& limits);
+
+/**
+ * An output of a multi-output part
+ */
+struct output_spec {
+  rat64 f;
+
+  // Largest output divider NCn_LS allowed for this output, at most 2^20
+  uint32_t NC_LS_max{1 << 20};
+};
+
+/**
+ * A solution for any number of outputs, which share everything but their
+ * output dividers
+ */
+struct multi_solution {
+  uint32_t fGPS;
+  uint32_t N31;
+  uint32_t N1_HS;
+  uint32_t N2_HS;
+  uint32_t N2_LS;
+
+  // NCn_LS for each output, in the order of the outputs
+  std::vector<uint32_t> NC_LS;
+
+  void write(std::ostream& os, bool verbose = false) const;
+  bool operator==(multi_solution const&) const = default;
+};
+
+/**
+ * Find solutions that generate all `outputs` from a single fOSC
+ *
+ * Behaves like find_solutions() for two frequencies, which is the special
+ * case of two outputs without extra divider limits, and returns solutions
+ * in the same order. Every output narrows the range of fOSC values to
+ * search, so more outputs don't make the search any slower. Throws
+ * std::invalid_argument if `outputs` is empty, a frequency isn't positive
+ * or a divider limit is out of range.
+ */
+std::vector<multi_solution> find_solutions(
+    std::span<output_spec const> outputs,
+    hardware_limits const& limits,
+    find algorithm = find::any,
+    search_options const& options = {});
+
+/**
+ * Solver for a fixed f1 and hardware limits
+ *
+ * The PLL part of a solution (fGPS, N31, N2_HS, N2_LS) only depends on
+ * the VCO frequency fOSC, and every fOSC is a multiple of f1. A solver
+ * remembers the PLL configurations of each fOSC it has searched, so
+ * searches for other values of f2 that share an fOSC don't need to redo
+ * that work. This makes sweeping f2 for a fixed f1 much faster than
+ * repeated calls to find_solutions(), which it otherwise behaves exactly
+ * like. The memory used grows with the number of distinct fOSC values.
+ *
+ * A solver can be used by one thread at a time, but its searches can use
+ * multiple threads.
+ */
+class solver {
+ public:
+  solver(rat64 f1, hardware_limits const& limits);
+  ~solver();
+
+  solver(solver const&) = delete;
+  solver& operator=(solver const&) = delete;
+
+  rat64 f1() const;
+  hardware_limits const& limits() const;
+
+  // Number of fOSC values with remembered PLL configurations. These are
+  // only remembered for find::{best,all,top_k}, as searches for the other
+  // modes usually stop too early to benefit.
+  size_t memo_size() const;
+
+  std::vector<solution> find_solutions(
+      rat64 f2,
+      find algorithm = find::any,
+      search_options const& options = {});
+
+ private:
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+/**
+ * Parse a frequency like "10M", "1000.31", "10_1/7k" or "500/9k"
+ *
+ * An integral part can be separated from a fraction by a single space or
+ * an underscore. Suffixes `M` and `k` multiply by 10^6 and 10^3. Throws
+ * std::invalid_argument for malformed input and numbers that don't fit
+ * into a rat64.
+ */
+rat64 parse_fraction(std::string const& str);
+
+/**
+ * Called for each solution found by for_each_solution(). Returning `false`
+ * stops the search.
+ */
+using solution_visitor = std::function<bool(solution const&)>;
+
+/**
+ * Pass all possible solutions to `visitor` as soon as they are found
+ *
+ * This is the streaming equivalent of find_solutions(..., find::all), except
+ * that solutions are visited in search order rather than being sorted. No
+ * solutions are buffered. Returns `false` if the visitor stopped the search.
+ */
+bool for_each_solution(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    solution_visitor const& visitor);
+
+/**
+ * Pass all possible solutions to `visitor` in the order of find::all
+ *
+ * Solutions are found in batches of growing size, each of which is a
+ * find::top_k search, so the first solutions are visited long before
+ * find::all would return and stopping early skips most of the search.
+ * The remaining solutions are searched with find::all once the batches
+ * get large. `options.top_k` and `options.timeout` are ignored, and the
+ * stats cover all batches. Returns `false` if the visitor stopped the
+ * search.
+ */
+bool for_each_sorted_solution(
+    rat64 f1,
+    rat64 f2,
+    hardware_limits const& limits,
+    solution_visitor const& visitor,
+    search_options const& options = {});
 
 } // namespace gpsdo_config
@@ -0,0 +1,152 @@
+#include "../gpsdo_config.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../solver.h"
+
+using namespace gpsdo_config;
+
+namespace {
+
+struct ctx_deleter {
+  void operator()(gpsdo_solver_ctx* ctx) const { gpsdo_solver_ctx_free(ctx); }
+};
+
+using ctx_ptr = std::unique_ptr<gpsdo_solver_ctx, ctx_deleter>;
+
+std::vector<solution> solve(
+    gpsdo_solver_ctx* ctx,
+    rat64 f1,
+    rat64 f2,
+    gpsdo_limits const* limits,
+    gpsdo_mode mode,
+    size_t cap) {
+  std::vector<gpsdo_solution> out(cap);
+  auto const n = gpsdo_solve_into(
+      ctx, f1.numerator(), f1.denominator(), f2.numerator(), f2.denominator(),
+      limits, mode, out.data(), out.size());
+  EXPECT_GE(n, 0) << gpsdo_solver_ctx_error(ctx);
+  std::vector<solution> rv;
+  for (ptrdiff_t i = 0; i < n; ++i) {
+    auto const& s = out[i];
+    rv.push_back(
+        {s.fGPS, s.N31, s.N1_HS, s.NC1_LS, s.NC2_LS, s.N2_HS, s.N2_LS});
+  }
+  return rv;
+}
+
+} // namespace
+
+TEST(CApi, MatchesFindSolutions) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+  } const pairs[] = {
+      {rat64(10'000'000), rat64(120'000'000)},
+      {rat64(10'000'000), rat64(96'000)},
+      {rat64(123'431, 100), rat64(5'432)},
+      {rat64(450), rat64(675)},
+      {rat64(1, 3), rat64(1, 7)},
+  };
+
+  struct {
+    gpsdo_mode mode;
+    find algorithm;
+  } const modes[] = {
+      {GPSDO_FIND_ANY, find::any},
+      {GPSDO_FIND_GOOD, find::good},
+      {GPSDO_FIND_BEST, find::best},
+      {GPSDO_FIND_ALL, find::top_k},
+  };
+
+  EXPECT_EQ(gpsdo_api_version(), GPSDO_CONFIG_API_VERSION);
+
+  for (unsigned threads : {1, 3}) {
+    ctx_ptr ctx(gpsdo_solver_ctx_new(threads));
+    ASSERT_TRUE(ctx);
+
+    for (auto const& p : pairs) {
+      for (auto const* lim :
+           {&gpsdo_si53xx_limits, &gpsdo_si53xx_relaxed_limits}) {
+        hardware_limits const limits{lim->VCO_LO, lim->VCO_HI, lim->F3_LO,
+                                     lim->F3_HI, lim->GPS_HI};
+
+        for (auto const& m : modes) {
+          for (size_t cap : {1, 5, 1000}) {
+            auto const expected = find_solutions(p.f1, p.f2, limits,
+                                                 m.algorithm, {.top_k = cap});
+            auto const n = std::min(expected.size(), cap);
+
+            EXPECT_EQ(solve(ctx.get(), p.f1, p.f2, lim, m.mode, cap),
+                      std::vector(expected.begin(), expected.begin() + n));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CApi, AllSolutions) {
+  ctx_ptr ctx(gpsdo_solver_ctx_new(1));
+  auto const all = find_solutions(rat64(123'431, 100), rat64(5'432),
+                                  si53xx_limits, find::all);
+
+  ASSERT_FALSE(all.empty());
+  EXPECT_EQ(solve(ctx.get(), rat64(123'431, 100), rat64(5'432), nullptr,
+                  GPSDO_FIND_ALL, all.size() + 10),
+            all);
+  EXPECT_TRUE(
+      solve(ctx.get(), rat64(450), rat64(675), nullptr, GPSDO_FIND_ALL, 0)
+          .empty());
+}
+
+TEST(CApi, Errors) {
+  ctx_ptr ctx(gpsdo_solver_ctx_new(1));
+  gpsdo_solution out[4];
+  auto const bad_limits = [] {
+    auto lim = gpsdo_si53xx_limits;
+    lim.VCO_HI = lim.VCO_LO - 1;
+    return lim;
+  }();
+  auto const huge_limits = [] {
+    auto lim = gpsdo_si53xx_limits;
+    lim.F3_HI = lim.GPS_HI = 900'000'000'000'000'000;
+    return lim;
+  }();
+
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10, 0, 10, 1, nullptr, GPSDO_FIND_ANY,
+                             out, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+  EXPECT_STREQ(gpsdo_solver_ctx_error(ctx.get()), "zero denominator");
+
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10, 1, -10, 1, nullptr,
+                             GPSDO_FIND_ANY, out, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10, 1, 10, 1, &bad_limits,
+                             GPSDO_FIND_ANY, out, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10'000'000, 1, 120'000'000, 1,
+                             &huge_limits, GPSDO_FIND_BEST, out, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+  EXPECT_STREQ(gpsdo_solver_ctx_error(ctx.get()), "F3 limits out of range");
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10, 1, 10, 1, nullptr,
+                             static_cast<gpsdo_mode>(42), out, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10, 1, 10, 1, nullptr,
+                             GPSDO_FIND_ANY, nullptr, 4),
+            GPSDO_ERROR_INVALID_ARGUMENT);
+
+  // The context is still usable after an error
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 10'000'000, 1, 120'000'000, 1,
+                             nullptr, GPSDO_FIND_BEST, out, 4),
+            1);
+  EXPECT_STREQ(gpsdo_solver_ctx_error(ctx.get()), "");
+
+  // No solutions isn't an error
+  EXPECT_EQ(gpsdo_solve_into(ctx.get(), 1, 1, 1, 1, nullptr, GPSDO_FIND_ANY,
+                             out, 4),
+            0);
+}
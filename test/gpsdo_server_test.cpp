@@ -0,0 +1,162 @@
+#include "../gpsdo_server.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace gpsdo_config;
+
+namespace {
+
+sockaddr_un socket_address(std::filesystem::path const& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+  return addr;
+}
+
+int checked(int rv, char const* what) {
+  if (rv < 0) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+  return rv;
+}
+
+class Server : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path()
+            / ("gpsdo_server_test_" + std::to_string(::getpid()));
+    std::filesystem::remove(path_);
+
+    auto const addr = socket_address(path_);
+    listen_fd_ = checked(::socket(AF_UNIX, SOCK_STREAM, 0), "socket");
+    checked(::bind(listen_fd_, reinterpret_cast<sockaddr const*>(&addr),
+                   sizeof(addr)),
+            "bind");
+    checked(::listen(listen_fd_, 4), "listen");
+  }
+
+  void TearDown() override {
+    ::close(listen_fd_);
+    std::filesystem::remove(path_);
+  }
+
+  int connect() const {
+    auto const addr = socket_address(path_);
+    auto const fd = checked(::socket(AF_UNIX, SOCK_STREAM, 0), "socket");
+    checked(::connect(fd, reinterpret_cast<sockaddr const*>(&addr),
+                      sizeof(addr)),
+            "connect");
+    return fd;
+  }
+
+  static void send_all(int fd, std::string const& data) {
+    EXPECT_EQ(::send(fd, data.data(), data.size(), MSG_NOSIGNAL),
+              static_cast<ssize_t>(data.size()));
+  }
+
+  // Read one line, or everything until EOF if `line` is false
+  static std::string receive(int fd, bool line = true) {
+    std::string rv;
+
+    for (char c; ::recv(fd, &c, 1, 0) == 1;) {
+      rv += c;
+
+      if (line and c == '\n') {
+        break;
+      }
+    }
+
+    return rv;
+  }
+
+  std::filesystem::path path_;
+  int listen_fd_{-1};
+};
+
+} // namespace
+
+TEST_F(Server, Request) {
+  std::atomic<bool> stop{false};
+  server srv(2, 10, false);
+  std::thread t([&] { srv.run(listen_fd_, stop); });
+
+  auto const fd = connect();
+  send_all(fd, R"({"id": 1, "f1": "10M", "f2": "120M", "mode": "best"})"
+               "\n"
+               R"({"id": 2, "f1": 0})"
+               "\n"
+               R"({"id": 3, "f1": "10M", "f2": "120M", )"
+               R"("limits": {"F3_HI": 900000000000000000}})"
+               "\n");
+
+  EXPECT_EQ(receive(fd),
+            R"({"id": 1, "solutions": [{"fGPS": 2000000, "N31": 1, )"
+            R"("N2_LS": 240, "N2_HS": 11, "N1_HS": 11, "NC1_LS": 48, )"
+            R"("NC2_LS": 4}]})"
+            "\n");
+  EXPECT_EQ(receive(fd),
+            R"({"id": 2, "error": "f1 must be positive"})"
+            "\n");
+  EXPECT_EQ(receive(fd),
+            R"({"id": 3, "error": "F3 limits out of range"})"
+            "\n");
+
+  stop = true;
+  t.join();
+
+  EXPECT_EQ(receive(fd, false), "");
+  ::close(fd);
+}
+
+TEST_F(Server, ShutdownWithQueuedRequests) {
+  size_t constexpr REQUESTS = 60;
+  size_t responses = 0;
+  int fd;
+
+  {
+    std::atomic<bool> stop{false};
+    server srv(1, 10'000, false);
+    std::thread t([&] { srv.run(listen_fd_, stop); });
+
+    fd = connect();
+
+    // Distinct requests that take a while, all of which are cached
+    std::string requests;
+
+    for (size_t i = 0; i < REQUESTS; ++i) {
+      requests += R"({"f1": 450, "f2": 675, "mode": "top", "top": )"
+                  + std::to_string(900 + i) + "}\n";
+    }
+
+    send_all(fd, requests);
+
+    if (!receive(fd).empty()) {
+      ++responses;
+    }
+
+    stop = true;
+    t.join();
+
+    for (auto const& rest = receive(fd, false); auto c : rest) {
+      responses += c == '\n';
+    }
+
+    // Solves the remaining requests, which must not outlive the cache
+  }
+
+  ::close(fd);
+
+  EXPECT_GE(responses, 1);
+  EXPECT_LT(responses, REQUESTS);
+}
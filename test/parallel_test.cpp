@@ -0,0 +1,70 @@
+#include "../parallel.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace gpsdo_config;
+
+TEST(Parallel, ParallelFor) {
+  for (unsigned threads : {0, 1, 4}) {
+    std::vector<std::atomic<int>> calls(1'000);
+
+    parallel_for(calls.size(), threads, [&](size_t i) { ++calls[i]; });
+
+    for (auto const& c : calls) {
+      EXPECT_EQ(c, 1);
+    }
+  }
+
+  EXPECT_THROW(parallel_for(100, 4,
+                            [](size_t i) {
+                              if (i == 42) {
+                                throw std::runtime_error("42");
+                              }
+                            }),
+               std::runtime_error);
+
+  parallel_for(0, 4, [](size_t) { FAIL(); });
+}
+
+TEST(Parallel, OrderedParallel) {
+  for (unsigned threads : {1, 4}) {
+    std::vector<size_t> consumed;
+
+    ordered_parallel(
+        200, threads,
+        [](size_t i) {
+          // Make later results likely to be ready first
+          std::this_thread::sleep_for(std::chrono::microseconds(200 - i));
+          return i * i;
+        },
+        [&](size_t r) { consumed.push_back(r); });
+
+    ASSERT_EQ(consumed.size(), 200);
+
+    for (size_t i = 0; i < consumed.size(); ++i) {
+      EXPECT_EQ(consumed[i], i * i);
+    }
+  }
+}
+
+TEST(Parallel, ThreadPoolFinishesQueuedJobs) {
+  std::atomic<int> done{0};
+
+  {
+    thread_pool pool(2);
+
+    for (int i = 0; i < 100; ++i) {
+      pool.submit([&] {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        ++done;
+      });
+    }
+  }
+
+  EXPECT_EQ(done, 100);
+}
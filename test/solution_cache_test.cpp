@@ -0,0 +1,247 @@
+#include "../solution_cache.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace gpsdo_config;
+
+namespace {
+
+hardware_limits const limits{
+    .VCO_LO = 4'850'000'000,
+    .VCO_HI = 5'670'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+    .GPS_HI = 10'000'000,
+};
+
+hardware_limits const relaxed_limits{
+    .VCO_LO = 3'500'000'000,
+    .VCO_HI = 6'500'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+    .GPS_HI = 10'000'000,
+};
+
+class SolutionCache : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto const* info = ::testing::UnitTest::GetInstance()->current_test_info();
+    path_ = std::filesystem::temp_directory_path()
+            / ("gpsdo_cache_test_" + std::to_string(::getpid()) + "_"
+               + info->name());
+    std::filesystem::remove(path_);
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  std::filesystem::path path_;
+};
+
+} // namespace
+
+TEST_F(SolutionCache, RoundTrip) {
+  auto const f1 = rat64(123'431, 100);
+  auto const f2 = rat64(5'432, 1);
+  auto const expected = find_solutions(f1, f2, limits, find::all);
+
+  {
+    solution_cache cache(path_);
+    EXPECT_FALSE(cache.lookup(f1, f2, limits, find::all));
+    EXPECT_TRUE(cache.find_solutions(f1, f2, limits, find::all) == expected);
+    EXPECT_EQ(cache.size(), 1);
+  }
+
+  solution_cache cache(path_);
+  EXPECT_EQ(cache.size(), 1);
+
+  auto cached = cache.lookup(f1, f2, limits, find::all);
+  ASSERT_TRUE(cached);
+  EXPECT_TRUE(*cached == expected);
+
+  EXPECT_FALSE(cache.lookup(f1, f2, limits, find::best));
+  EXPECT_FALSE(cache.lookup(f1, f2, relaxed_limits, find::all));
+}
+
+TEST_F(SolutionCache, TopKIsNotStored) {
+  auto const f1 = rat64(123'431, 100);
+  auto const f2 = rat64(5'432, 1);
+  search_options const options{.top_k = 5};
+  auto const expected = find_solutions(f1, f2, limits, find::top_k, options);
+  solution_cache cache(path_);
+
+  EXPECT_TRUE(
+      cache.find_solutions(f1, f2, limits, find::top_k, options) == expected);
+  EXPECT_EQ(cache.size(), 0);
+
+  cache.find_solutions(f1, f2, limits, find::all);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_TRUE(
+      cache.find_solutions(f1, f2, limits, find::top_k, options) == expected);
+}
+
+TEST_F(SolutionCache, TopKZeroIsAll) {
+  auto const f1 = rat64(123'431, 100);
+  auto const f2 = rat64(5'432, 1);
+  search_options const options{.top_k = 0};
+  auto const expected = find_solutions(f1, f2, limits, find::all);
+  solution_cache cache(path_);
+
+  EXPECT_TRUE(
+      cache.find_solutions(f1, f2, limits, find::top_k, options) == expected);
+
+  cache.find_solutions(f1, f2, limits, find::all);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_TRUE(
+      cache.find_solutions(f1, f2, limits, find::top_k, options) == expected);
+}
+
+TEST_F(SolutionCache, CostModelBypassesCache) {
+  auto const f1 = rat64(300'000'000, 1'531);
+  auto const f2 = rat64(1'200'000'000, 1'531);
+  cost_model const cost{.f3 = 1, .vco_margin = 2, .power = 1};
+  solution_cache cache(path_);
+
+  for (auto algo : {find::best, find::all, find::top_k}) {
+    auto const plain = cache.find_solutions(f1, f2, limits, algo);
+    auto const expected
+        = find_solutions(f1, f2, limits, algo, {.cost = &cost});
+
+    ASSERT_FALSE(plain == expected);
+    EXPECT_TRUE(
+        cache.find_solutions(f1, f2, limits, algo, {.cost = &cost})
+        == expected);
+  }
+
+  EXPECT_EQ(cache.size(), 2);
+}
+
+TEST_F(SolutionCache, TimedOutIsNotStored) {
+  using namespace std::chrono_literals;
+
+  auto const f1 = rat64(450, 1);
+  auto const f2 = rat64(675, 1);
+  solution_cache cache(path_);
+  bool timed_out = false;
+
+  cache.find_solutions(
+      f1, f2, limits, find::best, {.timeout = 1ms, .timed_out = &timed_out});
+  EXPECT_TRUE(timed_out);
+  EXPECT_EQ(cache.size(), 0);
+
+  auto const expected = find_solutions(f1, f2, limits, find::best);
+
+  cache.find_solutions(
+      f1, f2, limits, find::best, {.timeout = 60s, .timed_out = &timed_out});
+  EXPECT_FALSE(timed_out);
+  EXPECT_EQ(cache.size(), 1);
+
+  timed_out = true;
+  EXPECT_TRUE(
+      cache.find_solutions(
+          f1, f2, limits, find::best,
+          {.timeout = 1ms, .timed_out = &timed_out})
+      == expected);
+  EXPECT_FALSE(timed_out);
+}
+
+TEST_F(SolutionCache, SwappedFrequencies) {
+  auto const f1 = rat64(8'765, 1);
+  auto const f2 = rat64(4'321, 1);
+  solution_cache cache(path_);
+
+  cache.find_solutions(f1, f2, relaxed_limits, find::all);
+
+  auto cached = cache.lookup(f2, f1, relaxed_limits, find::all);
+  ASSERT_TRUE(cached);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_TRUE(*cached == find_solutions(f2, f1, relaxed_limits, find::all));
+}
+
+TEST_F(SolutionCache, NoSolutionIsCached) {
+  solution_cache cache(path_);
+
+  EXPECT_TRUE(cache.find_solutions(rat64(1, 3), rat64(1, 7), limits).empty());
+
+  auto cached = cache.lookup(rat64(1, 3), rat64(1, 7), limits, find::any);
+  ASSERT_TRUE(cached);
+  EXPECT_TRUE(cached->empty());
+}
+
+TEST_F(SolutionCache, SharedBetweenInstances) {
+  solution_cache writer(path_);
+  solution_cache reader(path_);
+
+  writer.find_solutions(rat64(10'000'000), rat64(96'000), limits, find::best);
+
+  EXPECT_TRUE(
+      reader.lookup(rat64(10'000'000), rat64(96'000), limits, find::best));
+}
+
+TEST_F(SolutionCache, ConcurrentCreation) {
+  for (int round = 0; round < 20; ++round) {
+    std::filesystem::remove(path_);
+
+    std::vector<std::unique_ptr<solution_cache>> caches(8);
+    std::vector<std::thread> threads;
+
+    for (auto& c : caches) {
+      threads.emplace_back(
+          [&] { c = std::make_unique<solution_cache>(path_.string()); });
+    }
+
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    caches.front()->find_solutions(
+        rat64(10'000'000), rat64(96'000), limits, find::best);
+
+    // A duplicate header would be misread as the start of a record
+    for (auto& c : caches) {
+      EXPECT_TRUE(
+          c->lookup(rat64(10'000'000), rat64(96'000), limits, find::best));
+      EXPECT_EQ(c->size(), 1);
+    }
+  }
+}
+
+TEST_F(SolutionCache, TruncatedRecordIsIgnored) {
+  {
+    solution_cache cache(path_);
+    cache.find_solutions(rat64(10'000'000), rat64(120'000'000), limits);
+    cache.find_solutions(
+        rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits,
+        find::all);
+  }
+
+  std::filesystem::resize_file(path_, std::filesystem::file_size(path_) - 1);
+
+  {
+    solution_cache cache(path_);
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_TRUE(cache.lookup(
+        rat64(10'000'000), rat64(120'000'000), limits, find::any));
+
+    cache.find_solutions(rat64(10'000'000), rat64(96'000), limits);
+  }
+
+  // The new record must not have been appended to the truncated one
+  solution_cache cache(path_);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(
+      cache.lookup(rat64(10'000'000), rat64(120'000'000), limits, find::any));
+  EXPECT_TRUE(
+      cache.lookup(rat64(10'000'000), rat64(96'000), limits, find::any));
+}
+
+TEST_F(SolutionCache, InvalidFile) {
+  std::ofstream(path_) << "this is not a cache";
+  EXPECT_THROW(solution_cache{path_}, std::runtime_error);
+}
@@ -0,0 +1,113 @@
+#include "../solution_index.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+using namespace gpsdo_config;
+
+namespace {
+
+class SolutionIndex : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto const* info = ::testing::UnitTest::GetInstance()->current_test_info();
+    path_ = std::filesystem::temp_directory_path()
+            / ("gpsdo_index_test_" + std::to_string(::getpid()) + "_"
+               + info->name());
+    std::filesystem::remove(path_);
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  std::filesystem::path path_;
+};
+
+solution_index::entry
+make_entry(rat64 f1, rat64 f2, hardware_limits const& limits) {
+  solution_index::entry e{.f1 = f1, .f2 = f2, .limits = limits, .best = {}};
+  auto const best = find_solutions(f1, f2, limits, find::best);
+  if (!best.empty()) {
+    e.best = best.front();
+  }
+  return e;
+}
+
+} // namespace
+
+TEST_F(SolutionIndex, Lookup) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+  } const pairs[] = {
+      {rat64(10'000'000), rat64(120'000'000)},
+      {rat64(123'431, 100), rat64(5'432)},
+      {rat64(8'765), rat64(4'321)},
+      {rat64(1, 3), rat64(1, 7)},
+      {rat64(10'000'000), rat64(96'000)},
+  };
+
+  std::vector<solution_index::entry> entries;
+
+  for (auto const& p : pairs) {
+    for (auto const* lim : {&si53xx_limits, &si53xx_relaxed_limits}) {
+      entries.push_back(make_entry(p.f1, p.f2, *lim));
+    }
+  }
+
+  EXPECT_EQ(solution_index::write(path_, entries), entries.size());
+
+  solution_index index(path_);
+  EXPECT_EQ(index.size(), entries.size());
+
+  for (auto const& p : pairs) {
+    for (auto const* lim : {&si53xx_limits, &si53xx_relaxed_limits}) {
+      auto indexed = index.lookup(p.f1, p.f2, *lim);
+      ASSERT_TRUE(indexed);
+      EXPECT_TRUE(*indexed == find_solutions(p.f1, p.f2, *lim, find::best));
+
+      auto swapped = index.lookup(p.f2, p.f1, *lim);
+      ASSERT_TRUE(swapped);
+      EXPECT_TRUE(*swapped == find_solutions(p.f2, p.f1, *lim, find::best));
+    }
+  }
+
+  EXPECT_FALSE(
+      index.lookup(rat64(10'000'000), rat64(10'000'000), si53xx_limits));
+
+  auto other_limits = si53xx_limits;
+  other_limits.GPS_HI = 5'000'000;
+  EXPECT_FALSE(
+      index.lookup(rat64(10'000'000), rat64(120'000'000), other_limits));
+}
+
+TEST_F(SolutionIndex, DuplicatesKeepLastEntry) {
+  auto e = make_entry(rat64(10'000'000), rat64(120'000'000), si53xx_limits);
+  auto swapped = e;
+  std::swap(swapped.f1, swapped.f2);
+  swapped.best.reset();
+
+  EXPECT_EQ(solution_index::write(path_, {e, swapped}), 1);
+
+  solution_index index(path_);
+  EXPECT_EQ(index.size(), 1);
+
+  auto indexed
+      = index.lookup(rat64(10'000'000), rat64(120'000'000), si53xx_limits);
+  ASSERT_TRUE(indexed);
+  EXPECT_TRUE(indexed->empty());
+}
+
+TEST_F(SolutionIndex, InvalidFile) {
+  std::ofstream(path_) << "this is not an index";
+  EXPECT_THROW(solution_index{path_}, std::runtime_error);
+
+  solution_index::write(path_, {});
+  std::filesystem::resize_file(path_, std::filesystem::file_size(path_) + 1);
+  EXPECT_THROW(solution_index{path_}, std::runtime_error);
+
+  std::filesystem::remove(path_);
+  EXPECT_THROW(solution_index{path_}, std::system_error);
+}
@@ -0,0 +1,283 @@
+#include "../solver.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+using namespace gpsdo_config;
+
+// Count every heap allocation made by the process so each benchmark can
+// report how many allocations a single solver call performs.
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+} // namespace
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// std::pmr::new_delete_resource() uses the aligned versions.
+void* operator new(size_t size, std::align_val_t al) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  auto const align = static_cast<size_t>(al);
+  if (auto p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+hardware_limits const limits{
+    .VCO_LO = 4'850'000'000,
+    .VCO_HI = 5'670'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+    .GPS_HI = 10'000'000,
+};
+
+hardware_limits const relaxed_limits{
+    .VCO_LO = 3'500'000'000,
+    .VCO_HI = 6'500'000'000,
+    .F3_LO = 2'000,
+    .F3_HI = 2'000'000,
+    .GPS_HI = 10'000'000,
+};
+
+struct bench_case {
+  char const* name;
+  rat64 f1;
+  rat64 f2;
+  hardware_limits const& lim;
+};
+
+// The cases from BasicTest, RegressionGithub2 and ExtremeTest. The first
+// ExtremeTest case has an enormous number of solutions and is what makes
+// `--all` slow; the others range from trivial to having nearly none.
+bench_case const fixed_cases[] = {
+    {"basic", rat64(123'431, 100), rat64(5'432, 1), limits},
+    {"github2_a", rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+    {"github2_b", rat64(4'681, 1), rat64(8'729, 1), relaxed_limits},
+    {"github2_c", rat64(4'681, 1), rat64(8'701, 1), relaxed_limits},
+    {"extreme_a", rat64(450, 1), rat64(675, 1), limits},
+    {"extreme_b", rat64(450, 1), rat64(46'800'000, 1), limits},
+    {"extreme_c", rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531),
+     limits},
+    {"extreme_d", rat64(5'000'000, 4'999), rat64(2'500'000'000'000, 4'999),
+     limits},
+};
+
+struct find_mode {
+  char const* name;
+  find algo;
+} const find_modes[] = {
+    {"any", find::any},
+    {"good", find::good},
+    {"best", find::best},
+    {"all", find::all},
+    {"top10", find::top_k},
+};
+
+using corpus = std::vector<std::pair<rat64, rat64>>;
+
+// A fixed-seed corpus of arbitrary rational frequency pairs between 1 kHz
+// and 200 MHz with the kind of small denominators users type on the command
+// line. Almost none of these have a solution, so every call runs the full
+// search without ever finding anything.
+corpus const& arbitrary_corpus() {
+  static auto const c = [] {
+    static constexpr int64_t denominators[] = {1, 1, 1, 3, 7, 10, 100, 1'000};
+    std::mt19937_64 rng{0x6a5d0c0f};
+    std::uniform_int_distribution<size_t> den_dist(
+        0, std::size(denominators) - 1);
+    corpus v;
+
+    auto random_freq = [&] {
+      auto const den = denominators[den_dist(rng)];
+      std::uniform_int_distribution<int64_t> num_dist(
+          1'000 * den, 200'000'000 * den);
+      return rat64(num_dist(rng), den);
+    };
+
+    for (size_t i = 0; i < 32; ++i) {
+      v.emplace_back(random_freq(), random_freq());
+    }
+
+    return v;
+  }();
+
+  return c;
+}
+
+// A fixed-seed corpus of frequency pairs derived from an integral fOSC and
+// random output dividers, i.e. pairs that a real configuration produces.
+corpus const& derived_corpus() {
+  static auto const c = [] {
+    std::mt19937_64 rng{0x3e1f5b27};
+    std::uniform_int_distribution<int64_t> fosc_dist(
+        limits.VCO_LO, limits.VCO_HI);
+    std::uniform_int_distribution<int64_t> n1_dist(4, 11);
+    std::uniform_int_distribution<int64_t> nc_dist(1, 10'000);
+    corpus v;
+
+    for (size_t i = 0; i < 32; ++i) {
+      auto const fOSC = fosc_dist(rng);
+      auto const N1_HS = n1_dist(rng);
+      v.emplace_back(rat64(fOSC, N1_HS * nc_dist(rng)),
+                     rat64(fOSC, N1_HS * nc_dist(rng)));
+    }
+
+    return v;
+  }();
+
+  return c;
+}
+
+void report(benchmark::State& state, uint64_t solutions, uint64_t allocs) {
+  state.counters["solutions"] =
+      benchmark::Counter(solutions, benchmark::Counter::kIsRate);
+  state.counters["allocs"] = benchmark::Counter(
+      allocs, benchmark::Counter::kAvgIterations);
+}
+
+// With `arena`, the solver's scratch memory comes from a buffer that is
+// reused for each call, like a long-running service would do.
+class scratch_arena {
+ public:
+  explicit scratch_arena(bool enabled)
+      : enabled_{enabled} {}
+
+  search_options options() { return {.memory = enabled_ ? &mr_ : nullptr}; }
+
+  void reset() { mr_.release(); }
+
+ private:
+  bool const enabled_;
+  std::array<std::byte, 1 << 20> buffer_;
+  std::pmr::monotonic_buffer_resource mr_{buffer_.data(), buffer_.size()};
+};
+
+void bm_fixed(
+    benchmark::State& state, bench_case const& bc, find algo, bool arena) {
+  auto sa = std::make_unique<scratch_arena>(arena);
+  uint64_t solutions = 0;
+  uint64_t allocs = 0;
+
+  for (auto _ : state) {
+    auto const before = allocations.load(std::memory_order_relaxed);
+    auto result = find_solutions(bc.f1, bc.f2, bc.lim, algo, sa->options());
+    allocs += allocations.load(std::memory_order_relaxed) - before;
+    solutions += result.size();
+    benchmark::DoNotOptimize(result);
+    sa->reset();
+  }
+
+  report(state, solutions, allocs);
+}
+
+void bm_corpus(
+    benchmark::State& state, corpus const& c, find algo, bool arena) {
+  auto sa = std::make_unique<scratch_arena>(arena);
+  uint64_t solutions = 0;
+  uint64_t allocs = 0;
+
+  for (auto _ : state) {
+    for (auto const& [f1, f2] : c) {
+      auto const before = allocations.load(std::memory_order_relaxed);
+      auto result = find_solutions(f1, f2, limits, algo, sa->options());
+      allocs += allocations.load(std::memory_order_relaxed) - before;
+      solutions += result.size();
+      benchmark::DoNotOptimize(result);
+      sa->reset();
+    }
+  }
+
+  report(state, solutions, allocs / c.size());
+  state.SetItemsProcessed(state.iterations() * c.size());
+}
+
+// Sweep f2 for a fixed f1, either with a `solver` that is reused for all
+// values of f2 (as a tuning workflow would) or with find_solutions().
+void bm_sweep(benchmark::State& state, find algo, bool reuse) {
+  auto const f1 = rat64(450, 1);
+  uint64_t solutions = 0;
+
+  for (auto _ : state) {
+    solver sv(f1, limits);
+
+    for (int64_t f2 = 600; f2 < 700; f2 += 5) {
+      auto result = reuse ? sv.find_solutions(rat64(f2, 1), algo)
+                          : find_solutions(f1, rat64(f2, 1), limits, algo);
+      solutions += result.size();
+      benchmark::DoNotOptimize(result);
+    }
+  }
+
+  state.counters["solutions"] =
+      benchmark::Counter(solutions, benchmark::Counter::kIsRate);
+}
+
+[[maybe_unused]] int const registered = [] {
+  for (auto const& mode : find_modes) {
+    for (bool arena : {false, true}) {
+      std::string const prefix = arena ? "arena/" : "";
+
+      for (auto const& bc : fixed_cases) {
+        benchmark::RegisterBenchmark(
+            (prefix + "fixed/" + bc.name + "/" + mode.name).c_str(), bm_fixed,
+            bc, mode.algo, arena)
+            ->Unit(benchmark::kMillisecond);
+      }
+
+      benchmark::RegisterBenchmark(
+          (prefix + "random/derived/" + mode.name).c_str(), bm_corpus,
+          derived_corpus(), mode.algo, arena)
+          ->Unit(benchmark::kMillisecond);
+
+      benchmark::RegisterBenchmark(
+          (prefix + "random/arbitrary/" + mode.name).c_str(), bm_corpus,
+          arbitrary_corpus(), mode.algo, arena)
+          ->Unit(benchmark::kMillisecond);
+    }
+
+    for (bool reuse : {false, true}) {
+      benchmark::RegisterBenchmark(
+          (std::string("sweep/") + (reuse ? "solver/" : "free/") + mode.name)
+              .c_str(),
+          bm_sweep, mode.algo, reuse)
+          ->Unit(benchmark::kMillisecond);
+    }
+  }
+
+  return 0;
+}();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,503 @@
+#include "../solver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Differential fuzzer for the solver
+ *
+ * Each input is decoded into a pair of frequencies, the limits, a search
+ * mode and a cost model. The result of the reference search, which uses
+ * arith::rational on a single thread, is compared with every other way of
+ * getting the same result: integer arithmetic, multiple threads, a solver
+ * with its memo and the multi-output search. For find::all, the streaming
+ * search, find::top_k and find::best are compared with it as well. Any
+ * difference, exception or invalid solution aborts, except for inputs with
+ * a zero or negative frequency, which every search must reject.
+ *
+ * Built with clang, this is a libFuzzer target. Otherwise, it is a driver
+ * that generates random inputs from a fixed seed:
+ *
+ *   solver_fuzz [--seed N] [--count N] [--timings FILE]
+ *               [--baseline FILE] [--slowdown X] [--max-ms MS] [FILE...]
+ *
+ * Input files, e.g. from a libFuzzer corpus, are used instead of random
+ * inputs if given. The time of the default search for each input is
+ * written to the `--timings` file. Inputs that take longer than `--max-ms`,
+ * or `--slowdown` times longer than in a `--baseline` file written by an
+ * earlier run, are reported and make the driver fail.
+ */
+
+using namespace gpsdo_config;
+
+namespace {
+
+/**
+ * Decode fuzzer input into numbers, which are all 0 once the input is
+ * exhausted
+ */
+class input_reader {
+ public:
+  input_reader(uint8_t const* data, size_t size)
+      : data_{data}
+      , size_{size} {}
+
+  // A number between lo and hi, consuming as few bytes as possible
+  int64_t next(int64_t lo, int64_t hi) {
+    auto const range = static_cast<uint64_t>(hi - lo);
+    uint64_t v = 0;
+
+    for (auto r = range; r > 0 and pos_ < size_; r >>= 8) {
+      v = (v << 8) | data_[pos_++];
+    }
+
+    return lo + static_cast<int64_t>(v % (range + 1));
+  }
+
+ private:
+  uint8_t const* const data_;
+  size_t const size_;
+  size_t pos_{0};
+};
+
+struct fuzz_input {
+  rat64 f1;
+  rat64 f2;
+  bool relaxed;
+  find algorithm;
+  size_t top_k;
+  cost_model cost;
+
+  hardware_limits const& limits() const {
+    return relaxed ? si53xx_relaxed_limits : si53xx_limits;
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, fuzz_input const& fi) {
+  static constexpr char const* names[] = {"any", "good", "best", "all", "top"};
+  return os << fi.f1 << " " << fi.f2 << (fi.relaxed ? " relaxed" : "") << " "
+            << names[static_cast<int>(fi.algorithm)] << " k=" << fi.top_k
+            << " cost=" << fi.cost.f3 << "," << fi.cost.vco_margin << ","
+            << fi.cost.power << "," << fi.cost.gps;
+}
+
+fuzz_input decode(uint8_t const* data, size_t size) {
+  input_reader in(data, size);
+  fuzz_input fi;
+
+  fi.relaxed = in.next(0, 1);
+
+  auto const& lim = fi.limits();
+
+  switch (in.next(0, 3)) {
+  case 0: {
+    // The outputs of a random configuration with fOSC near the middle of
+    // the VCO range, which always have solutions
+    auto const N31 = in.next(1, 5'000);
+    auto const fGPS = in.next(
+        lim.F3_LO * N31, std::min(lim.GPS_HI, lim.F3_HI * N31));
+    auto const N2_HS = in.next(4, 11);
+    auto const f3 = rat64(fGPS, N31);
+    auto const N2_LS = std::max<int64_t>(
+        2, 2 * boost::rational_cast<int64_t>(
+                   (lim.VCO_LO + lim.VCO_HI) / (4 * f3 * N2_HS)));
+    auto const fOSC = f3 * N2_HS * N2_LS;
+    auto const N1_HS = in.next(4, 11);
+    fi.f1 = fOSC / (N1_HS * 2 * in.next(1, 1 << 19));
+    fi.f2 = fOSC / (N1_HS * 2 * in.next(1, 1 << 19));
+    break;
+  }
+
+  case 1: {
+    // Arbitrary frequencies, which almost never have solutions
+    auto freq = [&] {
+      auto const den = in.next(1, 1'000'000);
+      return rat64(in.next(1, 1'000'000'000'000), den);
+    };
+    fi.f1 = freq();
+    fi.f2 = freq();
+    break;
+  }
+
+  case 2: {
+    // Frequencies with a small ratio
+    auto const den = in.next(1, 1'000);
+    fi.f1 = rat64(in.next(1'000 * den, 200'000'000 * den), den);
+    fi.f2 = fi.f1 * rat64(in.next(1, 64), in.next(1, 64));
+    break;
+  }
+
+  default: {
+    // At least one frequency that is zero or negative, which must be
+    // rejected
+    auto freq = [&] {
+      return rat64(in.next(-1'000'000'000, 0), in.next(1, 1'000));
+    };
+    fi.f1 = freq();
+    fi.f2 = in.next(0, 1) ? freq() : rat64(10'000'000);
+    if (in.next(0, 1)) {
+      std::swap(fi.f1, fi.f2);
+    }
+    break;
+  }
+  }
+
+  fi.algorithm = static_cast<find>(in.next(0, 4));
+  fi.top_k = in.next(0, 64);
+  fi.cost = {
+      .f3 = in.next(0, 4) / 4.0,
+      .vco_margin = in.next(0, 4) / 4.0,
+      .power = in.next(0, 4) / 4.0,
+      .gps = in.next(0, 4) / 4.0,
+  };
+
+  return fi;
+}
+
+void expect(bool ok, fuzz_input const& fi, char const* what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << " for " << fi << std::endl;
+    std::abort();
+  }
+}
+
+bool is_valid(solution const& sol, fuzz_input const& fi) {
+  auto const& lim = fi.limits();
+  auto const f3 = rat64{sol.fGPS, sol.N31};
+  auto const fOSC = f3 * sol.N2_HS * sol.N2_LS;
+
+  return f3 >= lim.F3_LO and f3 <= lim.F3_HI and fOSC >= lim.VCO_LO
+         and fOSC <= lim.VCO_HI and sol.fGPS <= lim.GPS_HI
+         and sol.N31 <= (1 << 19) and sol.N1_HS >= 4 and sol.N1_HS <= 11
+         and sol.N2_HS >= 4 and sol.N2_HS <= 11 and sol.N2_LS % 2 == 0
+         and sol.N2_LS <= (1 << 20) and sol.NC1_LS % 2 == 0
+         and sol.NC2_LS % 2 == 0 and sol.NC1_LS <= (1 << 20)
+         and sol.NC2_LS <= (1 << 20)
+         and fOSC / (sol.N1_HS * sol.NC1_LS) == fi.f1
+         and fOSC / (sol.N1_HS * sol.NC2_LS) == fi.f2;
+}
+
+// The first `n` solutions of `v`, all of them for 0 like find::top_k
+std::vector<solution> prefix(std::vector<solution> v, size_t n) {
+  if (n > 0) {
+    v.resize(std::min(n, v.size()));
+  }
+  return v;
+}
+
+/**
+ * Run all checks for an input and return the time taken by the default
+ * search for its mode
+ */
+std::chrono::nanoseconds run(fuzz_input const& fi) {
+  // find::all is only affordable for inputs with few solutions, the
+  // others are searched with find::top_k instead.
+  size_t constexpr ALL_MAX = 20'000;
+
+  auto const& lim = fi.limits();
+  auto algo = fi.algorithm;
+
+  if (fi.f1 <= 0 or fi.f2 <= 0) {
+    auto rejects = [&](auto const& fn) {
+      try {
+        fn();
+      } catch (std::invalid_argument const&) {
+        return true;
+      }
+      return false;
+    };
+
+    output_spec const outputs[] = {{.f = fi.f1}, {.f = fi.f2}};
+
+    expect(rejects([&] { find_solutions(fi.f1, fi.f2, lim, algo); }), fi,
+           "non-positive frequency accepted");
+    expect(rejects([&] { find_solutions(outputs, lim, algo); }), fi,
+           "non-positive frequency accepted by multi-output search");
+    expect(rejects([&] { check_feasibility(fi.f1, fi.f2, lim); }), fi,
+           "non-positive frequency accepted by check_feasibility");
+    expect(rejects([&] {
+             solver(fi.f1, lim).find_solutions(fi.f2, algo);
+           }),
+           fi, "non-positive frequency accepted by solver");
+
+    return std::chrono::nanoseconds::zero();
+  }
+
+  size_t count = 0;
+
+  if (algo == find::all or fi.top_k == 0) {
+    for_each_solution(fi.f1, fi.f2, lim, [&](solution const&) {
+      return ++count <= ALL_MAX;
+    });
+  }
+
+  if (algo == find::all and count > ALL_MAX) {
+    algo = find::top_k;
+  }
+
+  // k = 0 means all solutions, so it's subject to the same limit
+  auto const top_k = fi.top_k == 0 and count > ALL_MAX ? 1 : fi.top_k;
+
+  auto search = [&](find a, search_options opts) {
+    opts.top_k = top_k;
+    return find_solutions(fi.f1, fi.f2, lim, a, opts);
+  };
+
+  auto const start = std::chrono::steady_clock::now();
+  auto const result = search(algo, {});
+  auto const elapsed = std::chrono::steady_clock::now() - start;
+
+  for (auto const& sol : result) {
+    expect(is_valid(sol, fi), fi, "invalid solution");
+  }
+
+  auto const ref = search(algo, {.arithmetic = arith::rational});
+
+  expect(result == ref, fi, "integer and rational arithmetic differ");
+  expect(search(algo, {.threads = 3}) == ref, fi, "parallel search differs");
+  expect(
+      ref.empty()
+          or check_feasibility(fi.f1, fi.f2, lim) == infeasibility::none,
+      fi, "infeasible input has solutions");
+
+  // The second search replays the memo of the first.
+  solver sv(fi.f1, lim);
+
+  for (int i = 0; i < 2; ++i) {
+    auto const got = sv.find_solutions(fi.f2, algo, {.top_k = top_k});
+    expect(got == ref, fi, "solver differs");
+  }
+
+  output_spec const outputs[] = {{.f = fi.f1}, {.f = fi.f2}};
+  auto const multi = find_solutions(outputs, lim, algo, {.top_k = top_k});
+
+  expect(multi.size() == ref.size(), fi, "multi-output search differs");
+
+  for (size_t i = 0; i < multi.size(); ++i) {
+    auto const& m = multi[i];
+    solution const sol{
+        .fGPS = m.fGPS,
+        .N31 = m.N31,
+        .N1_HS = m.N1_HS,
+        .NC1_LS = m.NC_LS[0],
+        .NC2_LS = m.NC_LS[1],
+        .N2_HS = m.N2_HS,
+        .N2_LS = m.N2_LS,
+    };
+    expect(sol == ref[i], fi, "multi-output search differs");
+  }
+
+  auto const by_cost = search(
+      algo == find::all ? find::all : find::top_k, {.cost = &fi.cost});
+
+  for (unsigned threads : {1, 3}) {
+    search_options const opts{
+        .threads = threads, .top_k = top_k, .cost = &fi.cost};
+    auto const top = search(find::top_k, opts);
+
+    expect(top == prefix(by_cost, top_k), fi, "top_k by cost differs");
+    expect(
+        sv.find_solutions(fi.f2, find::top_k, opts) == top, fi,
+        "solver differs by cost");
+
+    if (algo == find::all) {
+      expect(
+          search(find::best, opts) == prefix(by_cost, 1), fi,
+          "best by cost isn't the first of all");
+    }
+  }
+
+  if (algo == find::all) {
+    std::vector<solution> streamed;
+
+    for_each_solution(fi.f1, fi.f2, lim, [&](solution const& sol) {
+      streamed.push_back(sol);
+      return true;
+    });
+
+    std::stable_sort(streamed.begin(), streamed.end());
+
+    expect(streamed == ref, fi, "streaming search differs");
+    expect(
+        search(find::top_k, {}) == prefix(ref, top_k), fi,
+        "top_k isn't a prefix of all");
+    expect(
+        search(find::best, {}) == prefix(ref, 1), fi,
+        "best isn't the first of all");
+    expect(
+        search(find::any, {}).empty() == ref.empty(), fi,
+        "any disagrees with all");
+    expect(by_cost.size() == ref.size(), fi, "all by cost differs");
+
+    for (size_t i = 1; i < by_cost.size(); ++i) {
+      expect(
+          fi.cost.cost(by_cost[i - 1], fi.f1, lim)
+              <= fi.cost.cost(by_cost[i], fi.f1, lim),
+          fi, "all isn't sorted by cost");
+    }
+  }
+
+  return elapsed;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  run(decode(data, size));
+  return 0;
+}
+
+#ifndef GPSDO_LIBFUZZER
+
+namespace {
+
+// Time differences below this are mostly noise.
+double constexpr MIN_REGRESSION_MS = 1.0;
+
+size_t constexpr RANDOM_INPUT_SIZE = 64;
+
+std::map<std::string, double> read_timings(std::string const& path) {
+  std::ifstream ifs(path);
+  std::map<std::string, double> timings;
+  std::string id;
+  double ms;
+
+  if (!ifs) {
+    throw std::runtime_error("cannot open " + path);
+  }
+
+  while (ifs >> id >> ms) {
+    timings[id] = ms;
+  }
+
+  return timings;
+}
+
+std::vector<uint8_t> read_file(std::string const& path) {
+  std::ifstream ifs(path, std::ios::binary);
+
+  if (!ifs) {
+    throw std::runtime_error("cannot open " + path);
+  }
+
+  return {std::istreambuf_iterator<char>(ifs), {}};
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  uint64_t seed = 1;
+  size_t count = 1'000;
+  double slowdown = 2.0;
+  double max_ms = 0.0;
+  std::string timings_file, baseline_file;
+  std::vector<std::string> files;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view const arg = argv[i];
+
+      auto value = [&] {
+        if (i + 1 >= argc) {
+          throw std::invalid_argument(std::string(arg) + " needs a value");
+        }
+        return std::string(argv[++i]);
+      };
+
+      if (arg == "--seed") {
+        seed = std::stoull(value());
+      } else if (arg == "--count") {
+        count = std::stoull(value());
+      } else if (arg == "--slowdown") {
+        slowdown = std::stod(value());
+      } else if (arg == "--max-ms") {
+        max_ms = std::stod(value());
+      } else if (arg == "--timings") {
+        timings_file = value();
+      } else if (arg == "--baseline") {
+        baseline_file = value();
+      } else if (arg.starts_with("-")) {
+        throw std::invalid_argument("unknown option " + std::string(arg));
+      } else {
+        files.emplace_back(arg);
+      }
+    }
+
+    auto const baseline = baseline_file.empty()
+                              ? std::map<std::string, double>{}
+                              : read_timings(baseline_file);
+    std::ofstream timings;
+    size_t checked = 0;
+    size_t slow = 0;
+
+    if (!timings_file.empty()) {
+      timings.open(timings_file);
+      if (!timings) {
+        throw std::runtime_error("cannot open " + timings_file);
+      }
+    }
+
+    auto check = [&](std::string const& id, std::vector<uint8_t> const& data) {
+      auto const fi = decode(data.data(), data.size());
+      std::chrono::duration<double, std::milli> const ms = run(fi);
+
+      if (timings) {
+        timings << id << " " << ms.count() << "\n";
+      }
+
+      if (max_ms > 0 and ms.count() > max_ms) {
+        std::cerr << "SLOW: " << id << " (" << fi << ") took " << ms.count()
+                  << " ms" << std::endl;
+        ++slow;
+      }
+
+      if (auto it = baseline.find(id); it != baseline.end()
+          and ms.count() > it->second * slowdown
+          and ms.count() - it->second > MIN_REGRESSION_MS) {
+        std::cerr << "REGRESSION: " << id << " (" << fi << ") took "
+                  << ms.count() << " ms, was " << it->second << " ms"
+                  << std::endl;
+        ++slow;
+      }
+
+      ++checked;
+    };
+
+    if (!files.empty()) {
+      for (auto const& f : files) {
+        check(f, read_file(f));
+      }
+    } else {
+      std::mt19937_64 rng{seed};
+      std::vector<uint8_t> data(RANDOM_INPUT_SIZE);
+
+      for (size_t i = 0; i < count; ++i) {
+        std::ranges::generate(data, [&] { return rng() & 0xff; });
+        check(std::to_string(i), data);
+      }
+    }
+
+    std::cerr << "checked " << checked << " inputs, " << slow << " too slow"
+              << std::endl;
+
+    return slow > 0 ? 1 : 0;
+  } catch (std::exception const& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 2;
+  }
+}
+
+#endif
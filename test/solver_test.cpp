@@ -1,6 +1,13 @@
 #include "../solver.h"
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <memory_resource>
+#include <random>
+#include <span>
+#include <tuple>
+#include <vector>
+
 using namespace gpsdo_config;
 
 namespace {
@@ -59,6 +66,49 @@ bool check_solution(
   return result;
 }
 
+bool check_multi_solution(
+    multi_solution const& sol,
+    hardware_limits const& lim,
+    std::span<output_spec const> outputs) {
+  auto const f3 = rat64{sol.fGPS, sol.N31};
+  auto const fOSC = f3 * sol.N2_HS * sol.N2_LS;
+  bool result = true;
+
+  if (f3 < lim.F3_LO || f3 > lim.F3_HI) {
+    std::cerr << "f3 out of range: " << f3 << "\n";
+    result = false;
+  }
+
+  if (fOSC < lim.VCO_LO || fOSC > lim.VCO_HI) {
+    std::cerr << "fOSC out of range: " << fOSC << "\n";
+    result = false;
+  }
+
+  if (sol.NC_LS.size() != outputs.size()) {
+    std::cerr << "expected " << outputs.size() << " dividers, got "
+              << sol.NC_LS.size() << "\n";
+    return false;
+  }
+
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    auto const nc = sol.NC_LS[i];
+    auto const f_got = fOSC / (sol.N1_HS * nc);
+
+    if (f_got != outputs[i].f) {
+      std::cerr << "f" << i + 1 << " mismatch: expected " << outputs[i].f
+                << ", got " << f_got << "\n";
+      result = false;
+    }
+
+    if (nc % 2 != 0 or nc > outputs[i].NC_LS_max) {
+      std::cerr << "NC" << i + 1 << "_LS out of range: " << nc << "\n";
+      result = false;
+    }
+  }
+
+  return result;
+}
+
 } // namespace
 
 TEST(Solver, BasicTest) {
@@ -135,3 +185,698 @@ TEST(Solver, ExtremeTest) {
     }
   }
 }
+
+TEST(Solver, StreamingTest) {
+  auto const f1 = rat64(123'431, 100);
+  auto const f2 = rat64(5'432, 1);
+  std::vector<solution> streamed;
+
+  EXPECT_TRUE(for_each_solution(f1, f2, limits, [&](solution const& s) {
+    streamed.emplace_back(s);
+    return true;
+  }));
+
+  auto solutions = find_solutions(f1, f2, limits, find::all);
+  std::stable_sort(streamed.begin(), streamed.end());
+  EXPECT_TRUE(streamed == solutions);
+
+  size_t count = 0;
+
+  EXPECT_FALSE(for_each_solution(
+      rat64(450, 1), rat64(675, 1), limits,
+      [&](solution const&) { return ++count < 10; }));
+
+  EXPECT_EQ(count, 10);
+}
+
+TEST(Solver, SortedStreamingTest) {
+  cost_model const cost{.f3 = 1, .vco_margin = 2, .power = 1};
+
+  struct {
+    rat64 f1;
+    rat64 f2;
+    search_options options;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), {}},
+      {rat64(10'000'000, 1), rat64(96'000, 1), {.threads = 3}},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), {}},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531),
+       {.cost = &cost}},
+      {rat64(4'681, 1), rat64(8'701, 1), {}},
+  };
+
+  for (auto const& tc : test_cases) {
+    std::vector<solution> streamed;
+    solver_stats stats;
+    auto options = tc.options;
+
+    options.stats = &stats;
+
+    EXPECT_TRUE(for_each_sorted_solution(
+        tc.f1, tc.f2, limits,
+        [&](solution const& s) {
+          streamed.emplace_back(s);
+          return true;
+        },
+        options));
+
+    EXPECT_TRUE(streamed == find_solutions(tc.f1, tc.f2, limits, find::all,
+                                           tc.options));
+    EXPECT_GE(stats.total().solutions, streamed.size());
+  }
+
+  std::vector<solution> streamed;
+
+  EXPECT_FALSE(for_each_sorted_solution(
+      rat64(450, 1), rat64(675, 1), limits, [&](solution const& s) {
+        streamed.emplace_back(s);
+        return streamed.size() < 100;
+      }));
+
+  EXPECT_TRUE(streamed == find_solutions(rat64(450, 1), rat64(675, 1),
+                                         limits, find::top_k, {.top_k = 100}));
+}
+
+TEST(Solver, ParallelTest) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(4'681, 1), rat64(8'701, 1), relaxed_limits},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits},
+      {rat64(10'000'000, 1), rat64(96'000, 1), limits},
+  };
+
+  for (auto const& tc : test_cases) {
+    for (auto algo : {find::any, find::good, find::best, find::all}) {
+      auto seq = find_solutions(tc.f1, tc.f2, tc.lim, algo);
+      auto par = find_solutions(tc.f1, tc.f2, tc.lim, algo, {.threads = 4});
+      EXPECT_TRUE(seq == par);
+    }
+  }
+}
+
+TEST(Solver, IntegerArithmeticTest) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(450, 1), rat64(46'800'000, 1), limits},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits},
+      {rat64(5'000'000, 4'999), rat64(2'500'000'000'000, 4'999), limits},
+      {rat64(71'000, 7), rat64(500'000, 9), relaxed_limits},
+  };
+
+  for (auto const& tc : test_cases) {
+    for (auto algo : {find::any, find::good, find::best, find::all}) {
+      auto ref = find_solutions(
+          tc.f1, tc.f2, tc.lim, algo, {.arithmetic = arith::rational});
+      auto fast = find_solutions(
+          tc.f1, tc.f2, tc.lim, algo, {.arithmetic = arith::integer});
+      EXPECT_TRUE(ref == fast);
+    }
+  }
+}
+
+TEST(Solver, BestIsFirstOfAll) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(450, 1), rat64(675, 1), limits},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits},
+      {rat64(71'000, 7), rat64(500'000, 9), relaxed_limits},
+      {rat64(100'031, 100), rat64(234'561, 100), limits},
+  };
+
+  for (auto const& tc : test_cases) {
+    auto all = find_solutions(tc.f1, tc.f2, tc.lim, find::all);
+    ASSERT_FALSE(all.empty());
+
+    for (unsigned threads : {1, 3}) {
+      auto best = find_solutions(
+          tc.f1, tc.f2, tc.lim, find::best, {.threads = threads});
+      ASSERT_EQ(best.size(), 1);
+      EXPECT_TRUE(best.front() == all.front());
+    }
+  }
+}
+
+TEST(Solver, SolutionSetTest) {
+  auto solutions = find_solutions(
+      rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits,
+      find::all);
+  ASSERT_GT(solutions.size(), 1);
+
+  solution const extreme{
+      .fGPS = UINT32_MAX,
+      .N31 = 1 << 19,
+      .N1_HS = 11,
+      .NC1_LS = 1 << 20,
+      .NC2_LS = 1 << 20,
+      .N2_HS = 11,
+      .N2_LS = 1 << 20,
+  };
+
+  solution_set set;
+
+  for (auto it = solutions.rbegin(); it != solutions.rend(); ++it) {
+    set.push_back(*it);
+  }
+  set.push_back(extreme);
+
+  ASSERT_EQ(set.size(), solutions.size() + 1);
+  EXPECT_TRUE(set[set.size() - 1] == extreme);
+
+  auto expected = set.to_vector();
+  std::stable_sort(expected.begin(), expected.end());
+  set.sort();
+
+  EXPECT_TRUE(set.to_vector() == expected);
+  EXPECT_TRUE(std::equal(set.begin(), set.end(), expected.begin()));
+}
+
+TEST(Solver, StatsTest) {
+  auto const f1 = rat64(300'000'000, 1'531);
+  auto const f2 = rat64(1'200'000'000, 1'531);
+
+  solver_stats seq, par;
+  auto solutions = find_solutions(f1, f2, limits, find::all, {.stats = &seq});
+  auto const parallel = find_solutions(
+      f1, f2, limits, find::all, {.threads = 3, .stats = &par});
+
+  EXPECT_TRUE(solutions == find_solutions(f1, f2, limits, find::all));
+  EXPECT_TRUE(solutions == parallel);
+
+  auto const total = seq.total();
+  EXPECT_EQ(total.solutions, solutions.size());
+  EXPECT_GT(total.q_values, total.fosc_duplicates);
+  EXPECT_GE(total.N31_candidates, total.solutions);
+  EXPECT_GT(seq.elapsed.count(), 0);
+
+  // Without pruning, the work done doesn't depend on the number of threads.
+  auto const ptotal = par.total();
+  EXPECT_EQ(ptotal.q_values, total.q_values);
+  EXPECT_EQ(ptotal.fosc_duplicates, total.fosc_duplicates);
+  EXPECT_EQ(ptotal.N31_candidates, total.N31_candidates);
+  EXPECT_EQ(ptotal.factor_calls, total.factor_calls);
+  EXPECT_EQ(ptotal.solutions, total.solutions);
+  EXPECT_EQ(par.by_N1_HS.size(), seq.by_N1_HS.size());
+
+  solver_stats best;
+  find_solutions(f1, f2, limits, find::best, {.stats = &best});
+  EXPECT_LT(best.total().factor_calls, total.factor_calls);
+}
+
+TEST(Solver, TopKTest) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(450, 1), rat64(675, 1), limits},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits},
+      {rat64(71'000, 7), rat64(500'000, 9), relaxed_limits},
+  };
+
+  for (auto const& tc : test_cases) {
+    auto all = find_solutions(tc.f1, tc.f2, tc.lim, find::all);
+    ASSERT_FALSE(all.empty());
+
+    for (size_t k : {1, 3, 10, 100, 1'000'000'000}) {
+      auto expected = all;
+      expected.resize(std::min(k, all.size()));
+
+      for (unsigned threads : {1, 3}) {
+        auto top = find_solutions(
+            tc.f1, tc.f2, tc.lim, find::top_k,
+            {.threads = threads, .top_k = k});
+        EXPECT_TRUE(top == expected)
+            << "k = " << k << ", threads = " << threads;
+      }
+    }
+  }
+
+  for (unsigned threads : {1, 3}) {
+    EXPECT_TRUE(find_solutions(
+                    rat64(123'431, 100), rat64(5'432, 1), limits, find::top_k,
+                    {.threads = threads, .top_k = 0})
+                == find_solutions(
+                    rat64(123'431, 100), rat64(5'432, 1), limits, find::all));
+  }
+}
+
+TEST(Solver, FixedF1SolverTest) {
+  struct {
+    rat64 f1;
+    hardware_limits const& lim;
+    std::vector<rat64> f2;
+  } const test_cases[] = {
+      {rat64(10'000'000, 1), limits,
+       {rat64(120'000'000, 1), rat64(96'000, 1), rat64(10'000'000, 1),
+        rat64(25'000'000, 1), rat64(12'500'000, 1), rat64(120'000'000, 1)}},
+      {rat64(123'431, 100), limits,
+       {rat64(5'432, 1), rat64(5'000, 1), rat64(2'000, 1), rat64(5'432, 1)}},
+      {rat64(4'681, 1), relaxed_limits,
+       {rat64(8'729, 1), rat64(8'701, 1), rat64(4'321, 1)}},
+  };
+
+  for (auto const& tc : test_cases) {
+    for (auto algo :
+         {find::any, find::good, find::best, find::all, find::top_k}) {
+      solver sv(tc.f1, tc.lim);
+      bool const memoized = algo != find::any and algo != find::good;
+
+      for (auto const& f2 : tc.f2) {
+        for (unsigned threads : {1, 3}) {
+          auto expected = find_solutions(tc.f1, f2, tc.lim, algo);
+          auto got = sv.find_solutions(f2, algo, {.threads = threads});
+          EXPECT_TRUE(got == expected)
+              << tc.f1 << " " << f2 << " " << static_cast<int>(algo);
+        }
+      }
+
+      EXPECT_EQ(sv.memo_size() > 0, memoized);
+    }
+  }
+}
+
+TEST(Solver, MemoryResourceTest) {
+  // Counts allocations that would otherwise have gone to the heap
+  class counting_resource : public std::pmr::memory_resource {
+   public:
+    explicit counting_resource(std::pmr::memory_resource* upstream)
+        : upstream_{upstream} {}
+
+    size_t allocations{0};
+
+   private:
+    void* do_allocate(size_t bytes, size_t align) override {
+      ++allocations;
+      return upstream_->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+      upstream_->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(memory_resource const& other) const noexcept override {
+      return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream_;
+  };
+
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+    arith arithmetic;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits, arith::integer},
+      {rat64(123'431, 100), rat64(5'432, 1), limits, arith::rational},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits, arith::integer},
+      {rat64(71'000, 7), rat64(500'000, 9), relaxed_limits, arith::rational},
+  };
+
+  // Running out of the buffer throws std::bad_alloc.
+  std::vector<std::byte> buffer(1 << 22);
+  std::pmr::monotonic_buffer_resource arena(
+      buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+  counting_resource cr(&arena);
+
+  for (auto const& tc : test_cases) {
+    for (auto algo :
+         {find::any, find::good, find::best, find::all, find::top_k}) {
+      auto expected = find_solutions(
+          tc.f1, tc.f2, tc.lim, algo, {.arithmetic = tc.arithmetic});
+
+      for (unsigned threads : {1, 3}) {
+        cr.allocations = 0;
+        auto got = find_solutions(
+            tc.f1, tc.f2, tc.lim, algo,
+            {.threads = threads,
+             .arithmetic = tc.arithmetic,
+             .memory = &cr});
+        arena.release();
+
+        EXPECT_TRUE(got == expected);
+        EXPECT_EQ(cr.allocations > 0, threads == 1);
+      }
+    }
+  }
+}
+
+TEST(Solver, TimeoutTest) {
+  using namespace std::chrono_literals;
+
+  // This takes far longer than the timeout for any of these modes.
+  auto const f1 = rat64(450, 1);
+  auto const f2 = rat64(675, 1);
+
+  for (auto algo : {find::best, find::all, find::top_k}) {
+    for (unsigned threads : {1, 3}) {
+      bool timed_out = false;
+      auto got = find_solutions(
+          f1, f2, limits, algo,
+          {.threads = threads, .timeout = 5ms, .timed_out = &timed_out});
+
+      EXPECT_TRUE(timed_out);
+
+      for (auto const& sol : got) {
+        EXPECT_TRUE(check_solution(sol, limits, f1, f2));
+      }
+    }
+  }
+
+  // A search that finishes in time returns the same as without timeout.
+  for (auto algo : {find::good, find::best, find::all}) {
+    auto const basic_f1 = rat64(123'431, 100);
+    auto const basic_f2 = rat64(5'432, 1);
+    bool timed_out = true;
+    auto got = find_solutions(
+        basic_f1, basic_f2, limits, algo,
+        {.timeout = 60s, .timed_out = &timed_out});
+
+    EXPECT_FALSE(timed_out);
+    EXPECT_TRUE(got == find_solutions(basic_f1, basic_f2, limits, algo));
+  }
+
+  // Timing out must not leave incomplete PLL configurations in a solver.
+  solver sv(f1, limits);
+  bool timed_out = false;
+
+  sv.find_solutions(
+      f2, find::top_k, {.timeout = 5ms, .timed_out = &timed_out});
+  EXPECT_TRUE(timed_out);
+  EXPECT_GT(sv.memo_size(), 0);
+  EXPECT_TRUE(
+      sv.find_solutions(f2, find::top_k)
+      == find_solutions(f1, f2, limits, find::top_k));
+}
+
+TEST(Solver, MultiOutputTest) {
+  // Two outputs are the same as a search for f1 and f2.
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const pairs[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(300'000'000, 1'531), rat64(1'200'000'000, 1'531), limits},
+  };
+
+  for (auto const& p : pairs) {
+    output_spec const outputs[] = {{.f = p.f1}, {.f = p.f2}};
+
+    for (auto algo : {find::any, find::good, find::best, find::all}) {
+      auto const expected = find_solutions(p.f1, p.f2, p.lim, algo);
+      auto const got = find_solutions(outputs, p.lim, algo, {.threads = 2});
+
+      ASSERT_EQ(got.size(), expected.size());
+
+      for (size_t i = 0; i < got.size(); ++i) {
+        auto const& e = expected[i];
+        EXPECT_TRUE(
+            got[i]
+            == multi_solution(
+                {.fGPS = e.fGPS,
+                 .N31 = e.N31,
+                 .N1_HS = e.N1_HS,
+                 .N2_HS = e.N2_HS,
+                 .N2_LS = e.N2_LS,
+                 .NC_LS = {e.NC1_LS, e.NC2_LS}}));
+      }
+    }
+  }
+
+  // Outputs of a 5 GHz fOSC with N1_HS = 5, and a single output.
+  std::vector<output_spec> const cases[] = {
+      {{.f = rat64(500'000'000, 1)},
+       {.f = rat64(100'000'000, 1)},
+       {.f = rat64(10'000'000, 1)},
+       {.f = rat64(1'000'000, 3)}},
+      {{.f = rat64(10'000'000, 1)}},
+  };
+
+  for (auto const& outputs : cases) {
+    auto const all = find_solutions(outputs, limits, find::all);
+
+    ASSERT_FALSE(all.empty());
+    EXPECT_TRUE(find_solutions(outputs, limits, find::best).front() == all[0]);
+
+    for (auto const& sol : all) {
+      EXPECT_TRUE(check_multi_solution(sol, limits, outputs));
+    }
+  }
+
+  // Divider limits of individual outputs are respected.
+  std::vector<output_spec> outputs = {
+      {.f = rat64(10'000'000, 1)},
+      {.f = rat64(1'000'000, 1)},
+  };
+  auto const unlimited = find_solutions(outputs, limits, find::all);
+  outputs[1].NC_LS_max = 1'000;
+  auto const limited = find_solutions(outputs, limits, find::all);
+
+  EXPECT_FALSE(limited.empty());
+  EXPECT_LT(limited.size(), unlimited.size());
+
+  for (auto const& sol : limited) {
+    EXPECT_TRUE(check_multi_solution(sol, limits, outputs));
+  }
+
+  EXPECT_THROW(find_solutions(std::span<output_spec const>{}, limits),
+               std::invalid_argument);
+  outputs[0].NC_LS_max = (1 << 20) + 2;
+  EXPECT_THROW(find_solutions(outputs, limits), std::invalid_argument);
+}
+
+TEST(Solver, FeasibilityTest) {
+  EXPECT_EQ(
+      check_feasibility(rat64(10, 1), rat64(3, 1), limits),
+      infeasibility::VCO_range);
+
+  // fOSC would need a multiple of 9973 in its denominator.
+  auto const f = rat64(900'000'000, 9'973);
+  EXPECT_EQ(check_feasibility(f, f, limits), infeasibility::N31_range);
+  EXPECT_TRUE(find_solutions(f, f, limits, find::all).empty());
+  EXPECT_TRUE(for_each_solution(f, f, limits, [](solution const&) {
+    return false;
+  }));
+
+  // Frequencies generated by a valid configuration always have solutions.
+  std::mt19937_64 rng{0x51ed27c3};
+  std::uniform_int_distribution<uint32_t> N31_dist(1, 5'000);
+  std::uniform_int_distribution<uint32_t> N1_HS_dist(4, 11);
+  std::uniform_int_distribution<uint32_t> N2_HS_dist(4, 11);
+  std::uniform_int_distribution<uint32_t> NC_dist(1, 1 << 19);
+  int checked = 0;
+
+  while (checked < 200) {
+    auto const N31 = N31_dist(rng);
+    auto const fGPS = std::uniform_int_distribution<uint32_t>(
+        limits.F3_LO * N31,
+        std::min(limits.GPS_HI, limits.F3_HI * N31))(rng);
+    auto const N2_HS = N2_HS_dist(rng);
+    auto const f3 = rat64(fGPS, N31);
+    auto const N2_LS = 2
+                       * boost::rational_cast<int64_t>(
+                           (limits.VCO_LO + limits.VCO_HI) / (4 * f3 * N2_HS));
+    auto const fOSC = f3 * N2_HS * N2_LS;
+
+    if (fOSC < limits.VCO_LO or fOSC > limits.VCO_HI or N2_LS > (1 << 20)) {
+      continue;
+    }
+
+    auto const N1_HS = N1_HS_dist(rng);
+    auto const f1 = fOSC / (N1_HS * 2 * NC_dist(rng));
+    auto const f2 = fOSC / (N1_HS * 2 * NC_dist(rng));
+
+    EXPECT_EQ(check_feasibility(f1, f2, limits), infeasibility::none)
+        << f1 << " " << f2;
+    EXPECT_FALSE(find_solutions(f1, f2, limits).empty()) << f1 << " " << f2;
+    ++checked;
+  }
+}
+
+TEST(Solver, NonPositiveFrequencyTest) {
+  auto const f = rat64(10'000'000, 1);
+
+  for (auto bad : {rat64(0), rat64(-10'000'000), rat64(-1, 3)}) {
+    EXPECT_THROW(find_solutions(bad, f, limits), std::invalid_argument);
+    EXPECT_THROW(find_solutions(f, bad, limits, find::all),
+                 std::invalid_argument);
+    EXPECT_THROW(check_feasibility(bad, f, limits), std::invalid_argument);
+    EXPECT_THROW(
+        for_each_solution(f, bad, limits, [](solution const&) { return true; }),
+        std::invalid_argument);
+    EXPECT_THROW(solver(f, limits).find_solutions(bad, find::best),
+                 std::invalid_argument);
+
+    output_spec const outputs[] = {{.f = f}, {.f = f / 2}, {.f = bad}};
+    EXPECT_THROW(find_solutions(outputs, limits), std::invalid_argument);
+  }
+}
+
+TEST(Solver, LimitsOutOfRangeTest) {
+  auto const f1 = rat64(10'000'000, 1);
+  auto const f2 = rat64(120'000'000, 1);
+
+  auto const bad = [](int64_t hardware_limits::*field, int64_t value) {
+    auto lim = limits;
+    lim.*field = value;
+    return lim;
+  };
+
+  for (auto const& lim :
+       {bad(&hardware_limits::VCO_LO, 0),
+        bad(&hardware_limits::VCO_HI, limits.VCO_LO - 1),
+        bad(&hardware_limits::VCO_HI, 10'000'000'001),
+        bad(&hardware_limits::F3_LO, -1),
+        bad(&hardware_limits::F3_HI, 900'000'000'000'000'000),
+        bad(&hardware_limits::GPS_HI, 900'000'000'000'000'000)}) {
+    EXPECT_THROW(check_limits(lim), std::invalid_argument);
+    EXPECT_THROW(find_solutions(f1, f2, lim, find::best),
+                 std::invalid_argument);
+    EXPECT_THROW(check_feasibility(f1, f2, lim), std::invalid_argument);
+  }
+
+  check_limits(limits);
+  check_limits(si53xx_relaxed_limits);
+}
+
+TEST(Solver, WideArithmeticTest) {
+  // The LCM of these has a small numerator, but going through their common
+  // denominator of 3'447'123'106'357 overflows.
+  auto const f1 = rat64(7'780'407'310, 8'824'093);
+  auto const f2 = rat64(31'121'629'240, 27'736'079);
+
+  for (auto a : {arith::integer, arith::rational}) {
+    auto const solutions
+        = find_solutions(f1, f2, limits, find::all, {.arithmetic = a});
+
+    EXPECT_EQ(solutions.size(), 8);
+
+    for (auto const& s : solutions) {
+      EXPECT_TRUE(check_solution(s, limits, f1, f2));
+    }
+  }
+
+  // The same for the output dividers of the multi-output search
+  output_spec const outputs[] = {{.f = f1}, {.f = f2}};
+  auto const expected = find_solutions(f1, f2, limits, find::all);
+  auto const multi = find_solutions(outputs, limits, find::all);
+
+  ASSERT_EQ(multi.size(), expected.size());
+
+  for (size_t i = 0; i < multi.size(); ++i) {
+    EXPECT_EQ(multi[i].NC_LS, std::vector<uint32_t>(
+                                  {expected[i].NC1_LS, expected[i].NC2_LS}));
+    EXPECT_TRUE(check_multi_solution(multi[i], limits, outputs));
+  }
+
+  // Here, the LCM itself doesn't fit, so there can't be any solutions.
+  auto const p1 = rat64(4'294'967'311, 1'000);
+  auto const p2 = rat64(4'294'967'357, 1'000);
+
+  EXPECT_EQ(check_feasibility(p1, p2, limits), infeasibility::N31_range);
+  EXPECT_TRUE(find_solutions(p1, p2, limits, find::all).empty());
+
+  EXPECT_EQ(parse_fraction("9223372036854775807"), rat64(INT64_MAX, 1));
+  EXPECT_EQ(parse_fraction("1_1/3M"), rat64(4'000'000, 3));
+  EXPECT_THROW(parse_fraction("9223372036854775808"), std::invalid_argument);
+  EXPECT_THROW(parse_fraction("10.0000000000000000001"), std::invalid_argument);
+  EXPECT_THROW(parse_fraction("9223372036854775807k"), std::invalid_argument);
+  EXPECT_THROW(parse_fraction("1_9223372036854775807/2"),
+               std::invalid_argument);
+}
+
+TEST(Solver, CostModelTest) {
+  struct {
+    rat64 f1;
+    rat64 f2;
+    hardware_limits const& lim;
+  } const test_cases[] = {
+      {rat64(123'431, 100), rat64(5'432, 1), limits},
+      {rat64(8'765, 1), rat64(4'321, 1), relaxed_limits},
+      {rat64(450, 1), rat64(675, 1), limits},
+      {rat64(10'000'000, 1), rat64(96'000, 1), limits},
+  };
+
+  cost_model const models[] = {
+      {},
+      {.f3 = 0, .power = 1},
+      {.f3 = 0, .vco_margin = 1},
+      {.f3 = 0.5, .gps = 1},
+      {.f3 = 1, .vco_margin = 0.3, .power = 0.2, .gps = 0.1},
+  };
+
+  auto fields = [](solution const& s) {
+    return std::tuple{
+        s.fGPS, s.N31, s.N1_HS, s.NC1_LS, s.NC2_LS, s.N2_HS, s.N2_LS};
+  };
+
+  for (auto const& tc : test_cases) {
+    auto by_f3 = find_solutions(tc.f1, tc.f2, tc.lim, find::all);
+    ASSERT_FALSE(by_f3.empty());
+
+    for (auto const& m : models) {
+      auto cost = [&](solution const& s) { return m.cost(s, tc.f1, tc.lim); };
+      auto all = find_solutions(tc.f1, tc.f2, tc.lim, find::all, {.cost = &m});
+
+      // The same solutions, ordered by cost
+      auto a = all;
+      auto b = by_f3;
+      std::ranges::sort(a, {}, fields);
+      std::ranges::sort(b, {}, fields);
+      EXPECT_TRUE(a == b);
+
+      for (size_t i = 1; i < all.size(); ++i) {
+        EXPECT_LE(cost(all[i - 1]), cost(all[i]));
+      }
+
+      auto const min_cost = cost(std::ranges::min(by_f3, {}, cost));
+      solver sv(tc.f1, tc.lim);
+
+      for (unsigned threads : {1, 3}) {
+        search_options const opts{.threads = threads, .cost = &m};
+
+        auto best = find_solutions(tc.f1, tc.f2, tc.lim, find::best, opts);
+        ASSERT_EQ(best.size(), 1);
+        EXPECT_EQ(best.front(), all.front());
+        EXPECT_EQ(cost(best.front()), min_cost);
+        EXPECT_TRUE(sv.find_solutions(tc.f2, find::best, opts) == best);
+
+        for (size_t k : {1, 10, 100}) {
+          auto expected = all;
+          expected.resize(std::min(k, all.size()));
+
+          auto o = opts;
+          o.top_k = k;
+          auto top = find_solutions(tc.f1, tc.f2, tc.lim, find::top_k, o);
+          EXPECT_TRUE(top == expected)
+              << "k = " << k << ", threads = " << threads;
+          EXPECT_TRUE(sv.find_solutions(tc.f2, find::top_k, o) == expected);
+        }
+      }
+    }
+  }
+
+  cost_model const negative{.power = -1};
+  EXPECT_THROW(
+      find_solutions(
+          rat64(450, 1), rat64(675, 1), limits, find::best,
+          {.cost = &negative}),
+      std::invalid_argument);
+}